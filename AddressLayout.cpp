@@ -0,0 +1 @@
+#include "AddressLayout.h"
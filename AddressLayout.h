@@ -0,0 +1,692 @@
+#ifndef LC3_LANGUAGE_EXTENDER_ADDRESSLAYOUT_H
+#define LC3_LANGUAGE_EXTENDER_ADDRESSLAYOUT_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Instruction.h"
+#include "LivenessAnalysis.h"
+#include "RegisterEffects.h"
+#include "SymbolTable.h"
+
+/// @brief Assigns an address to every line of the finished program and makes sure every PC-relative operand reaches
+/// its label: LD, ST, LDI, STI, LEA and BR reach 256 words back and 255 ahead, JSR 1024 back and 1023 ahead.
+/// A reference which is out of reach is redirected through a pool placed within reach of it. Loads and stores go
+/// through a .FILL holding the label's address (LD becomes LDI, ST becomes STI, LEA becomes LD), branches and calls go
+/// through a BRnzp to the label, and a generated string is moved into the pool itself. Pools are placed where execution
+/// never falls into them, after an unconditional branch, a jump, a return or HALT; where there is no such place within
+/// reach, a BRnzp over the pool is added. Inserting pools moves the code after them, so this repeats until everything
+/// fits.
+/// Lines which could not be parsed are assumed to take one word.
+class AddressLayout
+{
+private:
+    static constexpr int32_t MEMORY_SIZE        = 0x10000;
+    static constexpr size_t  MAXIMUM_PASSES     = 64;
+    /// @brief Pools stop taking entries at this size, and longer strings are never moved into one.
+    static constexpr int32_t MAXIMUM_POOL_WORDS = 64;
+    /// @brief Pools are placed this far inside the reach of a reference, so the code inserted in the same pass is
+    /// unlikely to push them out of it again.
+    static constexpr int32_t SLACK              = 32;
+
+    /// @brief Lines program[start] to program[end - 1], which execution never falls into.
+    struct Pool
+    {
+        size_t                                 start  = 0;
+        size_t                                 end    = 0;
+        /// @brief Set when the pool begins with a BRnzp over it.
+        bool                                   forced = false;
+        /// @brief Lines to be inserted before program[end] once the pass is over.
+        std::vector<Instruction>               pending;
+        int32_t                                pendingWords = 0;
+        /// @brief Where each pending entry will be, relative to program[end].
+        std::unordered_map<SymbolId, int32_t>  pendingOffsets;
+        /// @brief The .FILLs holding the address of each label, and the BRnzps to each label, by label. A pool may
+        /// hold several copies of an entry, made when the earlier ones were out of reach.
+        std::unordered_map<SymbolId, std::vector<SymbolId>> pointers;
+        std::unordered_map<SymbolId, std::vector<SymbolId>> islands;
+        /// @brief A word to save a borrowed register in, or NO_SYMBOL.
+        SymbolId                               spill = NO_SYMBOL;
+    };
+
+    /// @brief The addresses a pool entry may have to be within reach of a reference.
+    struct Window
+    {
+        int32_t low;
+        int32_t high;
+    };
+
+    SymbolTable&                         symbols;
+    /// @brief The name pool lines are attributed to.
+    SymbolId                             producer;
+    std::vector<Pool>                    pools;
+    size_t                               redirected = 0;
+    size_t                               generated  = 0;
+    /// @brief The label each pool entry leads to, and whether it is an island (a BRnzp) rather than a .FILL, by entry.
+    std::unordered_map<SymbolId, std::pair<SymbolId, bool>> entryTargets;
+    // Per pass
+    std::vector<int32_t>                 addresses;
+    std::unordered_map<SymbolId, size_t> labels;
+    /// @brief For each position a line may be inserted at, whether that would break a numeric offset spanning it.
+    std::vector<uint8_t>                 blocked;
+    /// @brief Whether each line belongs to a pool, and whether each position is strictly inside one.
+    std::vector<uint8_t>                 pooled;
+    std::vector<uint8_t>                 inPool;
+    /// @brief Positions execution never falls into, in order.
+    std::vector<size_t>                  sites;
+    /// @brief The positions right after .ORIG and at .END, between which lines may be inserted.
+    size_t                               codeStart  = 0;
+    size_t                               codeFinish = 0;
+    /// @brief Lines to be inserted after a line once the pass is over, by line.
+    std::unordered_map<size_t, std::vector<Instruction>> following;
+    std::vector<uint8_t>                 moved;
+
+    /// @brief The number of words a .STRINGZ of the given text takes, counting each escape sequence as one character.
+    static int32_t stringWords(std::string_view text)
+    {
+        int32_t words = 1;
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '\\' && i + 1 < text.size()) {
+                i++;
+            }
+            words++;
+        }
+        return words;
+    }
+
+    [[nodiscard]] int32_t sizeOf(const Instruction& line) const
+    {
+        switch (line.opcode) {
+            case Opcode::ORIG:
+            case Opcode::END:
+            case Opcode::LABEL:
+                return 0;
+            case Opcode::BLKW:
+                return std::max(line.immediate, 0);
+            case Opcode::STRINGZ:
+                return line.hasString() ? stringWords(symbols.getName(line.label)) : 1;
+            default:
+                return 1;
+        }
+    }
+
+    /// @brief How far the PC-relative operand of an instruction reaches, or std::nullopt if it has none.
+    static std::optional<Window> reachOf(const Instruction& line)
+    {
+        switch (line.opcode) {
+            case Opcode::BR:
+            case Opcode::LD:
+            case Opcode::LDI:
+            case Opcode::LEA:
+            case Opcode::ST:
+            case Opcode::STI:
+                return Window{-256, 255};
+            case Opcode::JSR:
+                return Window{-1024, 1023};
+            default:
+                return std::nullopt;
+        }
+    }
+
+    static bool isUnconditional(const Instruction& line)
+    {
+        switch (line.opcode) {
+            case Opcode::BR:
+                return RegisterEffects::isUnconditional(line);
+            case Opcode::JMP:
+            case Opcode::RET:
+            case Opcode::RTI:
+            case Opcode::HALT:
+                return true;
+            case Opcode::TRAP:
+                return line.immediate == 0x25;
+            default:
+                return false;
+        }
+    }
+
+    static bool isData(const Instruction& line)
+    {
+        return line.opcode == Opcode::FILL || line.opcode == Opcode::BLKW || line.opcode == Opcode::STRINGZ;
+    }
+
+    [[nodiscard]] std::string describe(const Instruction& line, size_t i) const
+    {
+        char address[8];
+        snprintf(address, sizeof(address), "x%04X", static_cast<unsigned>(addresses[i]));
+        return line.toString(symbols) + " (at " + address + ")";
+    }
+
+    void assignAddresses(const std::vector<Instruction>& program)
+    {
+        addresses.resize(program.size() + 1);
+        labels.clear();
+        int32_t address = 0;
+        for (size_t i = 0; i < program.size(); i++) {
+            auto& line = program[i];
+            if (line.opcode == Opcode::ORIG) {
+                address = line.immediate;
+            }
+            addresses[i] = address;
+            if (line.definedLabel != NO_SYMBOL) {
+                labels.emplace(line.definedLabel, i);
+            }
+            address += sizeOf(line);
+            if (address > MEMORY_SIZE) {
+                throw std::runtime_error("The program does not fit in memory, it runs past xFFFF at: " +
+                                         line.toString(symbols));
+            }
+        }
+        addresses[program.size()] = address;
+    }
+
+    /// @brief Finds the positions pools may go at, and those nothing may be inserted at.
+    void findSites(const std::vector<Instruction>& program)
+    {
+        size_t count = program.size();
+        pooled.assign(count + 1, false);
+        inPool.assign(count + 1, false);
+        for (auto& pool: pools) {
+            auto start = static_cast<ptrdiff_t>(pool.start);
+            auto end   = static_cast<ptrdiff_t>(pool.end);
+            std::fill(pooled.begin() + start, pooled.begin() + end, true);
+            std::fill(inPool.begin() + start + 1, inPool.begin() + end, true);
+        }
+
+        // Any numeric PC-relative offset, except the pools' own branches, pins the lines between it and its target.
+        std::vector<int> spans(count + 2, 0);
+        for (size_t i = 0; i < count; i++) {
+            auto& line = program[i];
+            if (!reachOf(line) || line.label != NO_SYMBOL || !line.hasImmediate() || pooled[i]) {
+                continue;
+            }
+            int32_t target = addresses[i] + 1 + line.immediate;
+            auto    t      = static_cast<size_t>(std::lower_bound(addresses.begin(), addresses.end() - 1, target) -
+                                                 addresses.begin());
+            spans[std::min(i, t) + 1]++;
+            spans[std::max(i, t) + 1]--;
+        }
+        blocked.assign(count + 1, false);
+        int open = 0;
+        for (size_t p = 0; p <= count; p++) {
+            open += spans[p];
+            blocked[p] = open > 0;
+        }
+
+        sites.clear();
+        codeStart  = count;
+        codeFinish = count;
+        bool flowing = true;
+        bool started = false;
+        for (size_t p = 0; p < count; p++) {
+            auto& line = program[p];
+            if (started && !flowing && !blocked[p] && !inPool[p]) {
+                sites.push_back(p);
+            }
+            if (line.opcode == Opcode::END) {
+                codeFinish = p;
+                break;
+            }
+            if (line.opcode == Opcode::ORIG) {
+                codeStart = p + 1;
+                started = true;
+                flowing = true;
+            }
+            else if (isUnconditional(line)) {
+                flowing = false;
+            }
+            else if (!isData(line)) {
+                flowing = true;
+            }
+        }
+    }
+
+    /// @brief Where the next entry added to a pool will be.
+    [[nodiscard]] int32_t nextAddress(const Pool& pool) const
+    {
+        return addresses[pool.end] + pool.pendingWords;
+    }
+
+    [[nodiscard]] bool hasRoom(const Pool& pool, int32_t words) const
+    {
+        return nextAddress(pool) + words - addresses[pool.start] <= MAXIMUM_POOL_WORDS;
+    }
+
+    /// @brief Finds a pool within the window which can take an entry of the given size, as near to the address near as
+    /// possible, creating one if need be. Pools execution falls into, which are jumped over, are the last resort.
+    /// Returns nullptr if there is no room for one in the window.
+    Pool* tryFindPool(Window window, int32_t words, int32_t near, const std::vector<Instruction>& program)
+    {
+        Pool* best = nullptr;
+        for (auto& pool: pools) {
+            int32_t address = nextAddress(pool);
+            if (address >= window.low && address <= window.high && hasRoom(pool, words) &&
+                (best == nullptr || std::abs(address - near) < std::abs(nextAddress(*best) - near))) {
+                best = &pool;
+            }
+        }
+        if (best != nullptr) {
+            return best;
+        }
+
+        // A position where a full pool ends is taken: a second pool there would be the same pool.
+        auto isFree = [&](size_t p) {
+            auto pool = std::lower_bound(pools.begin(), pools.end(), p, [](const Pool& q, size_t value) {
+                return q.end < value;
+            });
+            return !blocked[p] && !inPool[p] && (pool == pools.end() || pool->end != p || hasRoom(*pool, words));
+        };
+        auto nearer = [&](size_t p, size_t than, int32_t offset) {
+            return than > program.size() ||
+                   std::abs(addresses[p] + offset - near) < std::abs(addresses[than] + offset - near);
+        };
+
+        auto   first    = std::lower_bound(sites.begin(), sites.end(), window.low,
+                                           [&](size_t p, int32_t low) { return addresses[p] < low; });
+        size_t position = program.size() + 1;
+        for (auto site = first; site != sites.end() && addresses[*site] <= window.high; ++site) {
+            if (isFree(*site) && nearer(*site, position, 0)) {
+                position = *site;
+            }
+        }
+        if (position <= program.size()) {
+            return &createPool(position, false);
+        }
+
+        // No place execution never reaches: jump over the pool. The pool's first entry follows the BRnzp.
+        auto codeBegin = addresses.begin() + static_cast<ptrdiff_t>(codeStart);
+        auto codeEnd   = addresses.begin() + static_cast<ptrdiff_t>(codeFinish) + 1;
+        auto low       = std::lower_bound(codeBegin, codeEnd, window.low - 1);
+        for (auto it = low; it != codeEnd && *it <= window.high - 1; ++it) {
+            auto p = static_cast<size_t>(it - addresses.begin());
+            if (isFree(p) && nearer(p, position, 1)) {
+                position = p;
+            }
+        }
+        return position > program.size() ? nullptr : &createPool(position, true);
+    }
+
+    /// @brief As tryFindPool(), throwing if there is no room within reach of program[reference], which needs the pool.
+    Pool& findPool(Window window, int32_t words, int32_t near, const std::vector<Instruction>& program,
+                   size_t reference)
+    {
+        auto pool = tryFindPool(window, words, near, program);
+        if (pool == nullptr) {
+            throw std::runtime_error("No room for a pool within reach of: " + describe(program[reference], reference));
+        }
+        return *pool;
+    }
+
+    Pool& createPool(size_t position, bool forced)
+    {
+        for (auto& pool: pools) {
+            if (pool.end == position) {
+                return pool;
+            }
+        }
+        Pool pool;
+        pool.start  = position;
+        pool.end    = position;
+        pool.forced = forced;
+        if (forced) {
+            pool.pending.push_back(Instruction::create(Opcode::BR).withImmediate(0).withProducer(producer));
+            pool.pendingWords = 1;
+        }
+        auto it = std::lower_bound(pools.begin(), pools.end(), position,
+                                   [](const Pool& p, size_t value) { return p.end < value; });
+        return *pools.insert(it, std::move(pool));
+    }
+
+    /// @brief Where an entry of the pool is, or will be once the pass is over.
+    [[nodiscard]] int32_t entryAddress(const Pool& pool, SymbolId label) const
+    {
+        if (auto placed = labels.find(label); placed != labels.end()) {
+            return addresses[placed->second];
+        }
+        return addresses[pool.end] + pool.pendingOffsets.at(label);
+    }
+
+    SymbolId addEntry(Pool& pool, const Instruction& entry)
+    {
+        if (entry.definedLabel != NO_SYMBOL) {
+            pool.pendingOffsets.emplace(entry.definedLabel, pool.pendingWords);
+        }
+        pool.pending.push_back(entry);
+        pool.pendingWords += sizeOf(entry);
+        return entry.definedLabel;
+    }
+
+    /// @brief Finds or creates a .FILL of the label's address (or a BRnzp to the label, for an island) in the window,
+    /// for program[reference]. Islands are kept as near to the label as possible, so chains of them stay short.
+    SymbolId findEntry(SymbolId target, bool island, Window window, const std::vector<Instruction>& program,
+                       size_t reference)
+    {
+        int32_t  near  = island ? addresses[labels.at(target)] : addresses[reference];
+        SymbolId found = NO_SYMBOL;
+        int32_t  foundAddress = 0;
+        // A new entry is placed SLACK inside the reach of the reference, but any copy already within reach will do.
+        // Should lines inserted in this pass push it out of reach, the next pass redirects the reference again.
+        // Islands keep to the window, which towards() narrowed to one side of the reference.
+        Window reachable = island ? window : Window{window.low - SLACK, window.high + SLACK};
+        for (auto& pool: pools) {
+            auto& entries = island ? pool.islands : pool.pointers;
+            auto  copies  = entries.find(target);
+            if (copies == entries.end()) {
+                continue;
+            }
+            for (auto entry: copies->second) {
+                // An island which is itself out of reach must not be sent to itself.
+                if (entry == program[reference].definedLabel) {
+                    continue;
+                }
+                int32_t address = entryAddress(pool, entry);
+                if (address >= reachable.low && address <= reachable.high &&
+                    (found == NO_SYMBOL || std::abs(address - near) < std::abs(foundAddress - near))) {
+                    found        = entry;
+                    foundAddress = address;
+                }
+            }
+        }
+        if (found != NO_SYMBOL) {
+            return found;
+        }
+
+        // An island goes in the half of the window nearer the label if it can, so each hop of a chain gets far.
+        Pool* nearHalf = nullptr;
+        if (island && near > window.high) {
+            nearHalf = tryFindPool({(window.low + window.high) / 2, window.high}, 1, near, program);
+        }
+        else if (island && near < window.low) {
+            nearHalf = tryFindPool({window.low, (window.low + window.high) / 2}, 1, near, program);
+        }
+        auto& pool     = nearHalf != nullptr ? *nearHalf : findPool(window, 1, near, program, reference);
+        auto  name     = island ? "__layout_island_" : "__layout_pointer_";
+        auto  label    = symbols.generate(name + std::to_string(generated++));
+        auto  entry    = island ? Instruction::create(Opcode::BR).withLabel(target)
+                                : Instruction::create(Opcode::FILL).withLabel(target);
+        size_t position = pool.end;
+        size_t index    = pool.pending.size();
+        int32_t pc      = nextAddress(pool) + 1;
+        addEntry(pool, entry.withDefinedLabel(label).withProducer(producer));
+
+        // An island still out of reach of the label goes through the next island right away, rather than a pass later.
+        // It is only registered afterwards, so it is not taken for the next island itself.
+        if (island && (near - pc < -256 || near - pc > 255)) {
+            auto hop   = findEntry(target, true, towards({pc - 256 + SLACK, pc + 255 - SLACK}, pc, target), program,
+                                   reference);
+            auto owner = std::find_if(pools.begin(), pools.end(), [&](auto& p) { return p.end == position; });
+            owner->pending[index].label = hop;
+        }
+        auto owner = std::find_if(pools.begin(), pools.end(), [&](auto& p) { return p.end == position; });
+        (island ? owner->islands : owner->pointers)[target].push_back(label);
+        entryTargets.emplace(label, std::pair{target, island});
+        return label;
+    }
+
+    /// @brief Finds or creates a word to save a borrowed register in, in the window, for program[reference].
+    SymbolId findSpill(Window window, const std::vector<Instruction>& program, size_t reference)
+    {
+        for (auto& pool: pools) {
+            if (pool.spill == NO_SYMBOL) {
+                continue;
+            }
+            int32_t address = entryAddress(pool, pool.spill);
+            if (address >= window.low && address <= window.high) {
+                return pool.spill;
+            }
+        }
+        auto& pool  = findPool(window, 1, addresses[reference], program, reference);
+        pool.spill  = symbols.generate("__layout_spill_" + std::to_string(generated++));
+        auto  entry = Instruction::create(Opcode::BLKW).withImmediate(1).withDefinedLabel(pool.spill);
+        return addEntry(pool, entry.withProducer(producer));
+    }
+
+    /// @brief Whether the line defining a label is a generated string which may be moved next to its users. A string
+    /// following a .FILL may be the end of a longer one, which is stored partly as .FILLs, and stays where it is.
+    [[nodiscard]] bool isMovable(size_t i, const std::vector<Instruction>& program) const
+    {
+        auto& line = program[i];
+        return line.opcode == Opcode::STRINGZ && symbols.isGenerated(line.definedLabel) && !pooled[i] && !moved[i] &&
+               sizeOf(line) <= MAXIMUM_POOL_WORDS / 2 && (i == 0 || program[i - 1].opcode != Opcode::FILL);
+    }
+
+    /// @brief Narrows the window of a branch to the side of its destination. Every island a branch goes through is then
+    /// nearer to the destination than the branch, which itself is at pc - 1, so a chain of islands always ends.
+    [[nodiscard]] Window towards(Window window, int32_t pc, SymbolId destination) const
+    {
+        if (addresses[labels.at(destination)] >= pc) {
+            window.low = std::max(window.low, pc);
+        }
+        else {
+            window.high = std::min(window.high, pc - 2);
+        }
+        return window;
+    }
+
+    /// @brief Makes program[i], whose operand is out of reach, go through a pool instead.
+    void redirect(std::vector<Instruction>& program, size_t i, Window reach)
+    {
+        auto&   line   = program[i];
+        int32_t pc     = addresses[i] + 1;
+        Window  window = {pc + reach.low + SLACK, pc + reach.high - SLACK};
+        auto    target = line.label;
+        if (auto entry = entryTargets.find(target); entry != entryTargets.end()) {
+            // Already redirected, but the pool has since moved out of reach: use one nearer by.
+            auto [destination, island] = entry->second;
+            line.label = findEntry(destination, island, island ? towards(window, pc, destination) : window, program, i);
+            return;
+        }
+        redirected++;
+        switch (line.opcode) {
+            case Opcode::BR:
+            case Opcode::JSR:
+                line.label = findEntry(target, true, towards(window, pc, target), program, i);
+                return;
+            case Opcode::LEA: {
+                size_t t = labels[target];
+                if (isMovable(t, program)) {
+                    auto& pool = findPool(window, sizeOf(program[t]), addresses[i], program, i);
+                    addEntry(pool, program[t]);
+                    moved[t] = true;
+                    return;
+                }
+                // LD sets the condition codes, which LEA leaves alone. Where they are still needed, the register they
+                // were last set from is tested again after the LD: LD r, F / ADD c, c, #0.
+                auto source = LivenessAnalysis::conditionCodeSource(program, i);
+                bool retest = !LivenessAnalysis::isDead(program, i + 1, NO_REGISTERS, true, &labels) &&
+                              source != -1;
+                if (retest && (!source || *source == line.registers[0] || i + 1 == program.size() ||
+                               blocked[i + 1] || inPool[i + 1])) {
+                    throw std::runtime_error("Unable to reach " + symbols.getName(target) +
+                                             " without changing the condition codes from: " + describe(line, i));
+                }
+                line.opcode = Opcode::LD;
+                line.label  = findEntry(target, false, window, program, i);
+                if (retest) {
+                    following[i].push_back(Instruction::create(Opcode::ADD, {*source, *source}).withImmediate(0)
+                                                   .withOriginOf(line));
+                }
+                return;
+            }
+            case Opcode::LD:
+                line.opcode = Opcode::LDI;
+                line.label  = findEntry(target, false, window, program, i);
+                return;
+            case Opcode::ST:
+                line.opcode = Opcode::STI;
+                line.label  = findEntry(target, false, window, program, i);
+                return;
+            case Opcode::LDI:
+                // LDI r, L / LDR r, r, #0, where L holds the address of the original label.
+                if (blocked[i + 1] || inPool[i + 1]) {
+                    throw std::runtime_error("Unable to reach " + symbols.getName(target) + " from: " +
+                                             describe(line, i));
+                }
+                line.label = findEntry(target, false, window, program, i);
+                following[i].push_back(Instruction::create(Opcode::LDR, {line.registers[0], line.registers[0]})
+                                               .withImmediate(0).withOriginOf(line));
+                return;
+            case Opcode::STI: {
+                // STI r, P / LD t, P, as in a push, stores through P the same way as LD t, P / STR r, t, #0, which only
+                // leaves a load to redirect.
+                if (i + 1 == program.size() || blocked[i + 1] || inPool[i + 1]) {
+                    throw std::runtime_error("Unable to reach " + symbols.getName(target) + " from: " +
+                                             describe(line, i));
+                }
+                auto& next = program[i + 1];
+                if (next.opcode == Opcode::LD && next.registerCount == 1 &&
+                    next.label == target && next.definedLabel == NO_SYMBOL && next.registers[0] != line.registers[0]) {
+                    int r = line.registers[0];
+                    int t = next.registers[0];
+                    line  = Instruction::create(Opcode::LD, {t}).withLabel(target).withDefinedLabel(line.definedLabel)
+                                                                   .withOriginOf(line);
+                    next  = Instruction::create(Opcode::STR, {r, t}).withImmediate(0).withOriginOf(next);
+                    redirected--;
+                    redirect(program, i, reach);
+                    return;
+                }
+                // Otherwise a register is borrowed, and saved in the pool: ST s, S / LDI s, F / STR r, s, #0 / LD s, S,
+                // where F holds the address of P. Unlike STI, restoring s sets the condition codes; where they are
+                // still needed and were set from another register c, ADD c, c, #0 follows.
+                int  r       = line.registers[0];
+                int  s       = r == 0 ? 1 : 0;
+                auto source  = LivenessAnalysis::conditionCodeSource(program, i);
+                bool retest  = !LivenessAnalysis::isDead(program, i + 1, NO_REGISTERS, true, &labels) &&
+                               source != -1 && source != s;
+                if (retest && !source) {
+                    throw std::runtime_error("Unable to reach " + symbols.getName(target) +
+                                             " without changing the condition codes from: " + describe(line, i));
+                }
+                auto pointer = findEntry(target, false, window, program, i);
+                auto spill   = findSpill(window, program, i);
+                line         = Instruction::create(Opcode::ST, {s}).withLabel(spill).withDefinedLabel(line.definedLabel)
+                                                                   .withOriginOf(line);
+                following[i] = {Instruction::create(Opcode::LDI, {s}).withLabel(pointer).withOriginOf(line),
+                                Instruction::create(Opcode::STR, {r, s}).withImmediate(0).withOriginOf(line),
+                                Instruction::create(Opcode::LD, {s}).withLabel(spill).withOriginOf(line)};
+                if (retest) {
+                    following[i].push_back(Instruction::create(Opcode::ADD, {*source, *source}).withImmediate(0)
+                                                   .withOriginOf(line));
+                }
+                return;
+            }
+            default:
+                return;
+        }
+    }
+
+    /// @brief Inserts the pools' pending lines and the lines following redirected ones, and drops the moved lines.
+    void rebuild(std::vector<Instruction>& program)
+    {
+        size_t                   count = program.size();
+        std::vector<int>         poolAt(count + 1, -1);
+        for (size_t k = 0; k < pools.size(); k++) {
+            poolAt[pools[k].end] = static_cast<int>(k);
+        }
+        std::vector<size_t>      remap(count + 1);
+        std::vector<Instruction> output;
+        output.reserve(count + count / 8);
+        for (size_t i = 0; i <= count; i++) {
+            if (poolAt[i] >= 0) {
+                auto& pool = pools[poolAt[i]];
+                if (pool.start == pool.end) {
+                    pool.start = output.size();
+                }
+                else {
+                    pool.start = remap[pool.start];
+                }
+                output.insert(output.end(), pool.pending.begin(), pool.pending.end());
+                pool.pending.clear();
+                pool.pendingOffsets.clear();
+                pool.pendingWords = 0;
+            }
+            remap[i] = output.size();
+            if (i == count) {
+                break;
+            }
+            if (!moved[i]) {
+                output.push_back(program[i]);
+            }
+            if (auto lines = following.find(i); lines != following.end()) {
+                output.insert(output.end(), lines->second.begin(), lines->second.end());
+            }
+        }
+        for (auto& pool: pools) {
+            pool.end = remap[pool.end];
+        }
+        program = std::move(output);
+    }
+
+public:
+    explicit AddressLayout(SymbolTable& symbols) : symbols(symbols), producer(symbols.intern("ADDRESS LAYOUT"))
+    {
+    }
+
+    /// @brief Lays the program out, redirecting out-of-range references through pools. Throws std::runtime_error,
+    /// naming the line concerned, if the program does not fit in memory or a reference cannot be redirected.
+    /// Every call starts afresh, so a program can be laid out again after it was edited.
+    void layOut(std::vector<Instruction>& program)
+    {
+        pools.clear();
+        entryTargets.clear();
+        redirected = 0;
+        generated  = 0;
+        for (size_t pass = 0; pass < MAXIMUM_PASSES; pass++) {
+            assignAddresses(program);
+            for (auto& pool: pools) {
+                if (pool.forced) {
+                    program[pool.start].immediate = addresses[pool.end] - addresses[pool.start] - 1;
+                }
+            }
+            findSites(program);
+            following.clear();
+            moved.assign(program.size(), false);
+
+            bool changed = false;
+            for (size_t i = 0; i < program.size(); i++) {
+                auto& line  = program[i];
+                auto  reach = reachOf(line);
+                if (!reach || !line.hasLabel() || moved[i]) {
+                    continue;
+                }
+                auto target = labels.find(line.label);
+                if (target == labels.end()) {
+                    continue;
+                }
+                int32_t offset = addresses[target->second] - (addresses[i] + 1);
+                if (offset < reach->low || offset > reach->high) {
+                    redirect(program, i, *reach);
+                    changed = true;
+                }
+            }
+            if (!changed) {
+                return;
+            }
+            rebuild(program);
+        }
+        throw std::runtime_error("Unable to lay out the program, references were still out of reach after " +
+                                 std::to_string(MAXIMUM_PASSES) + " passes.");
+    }
+
+    /// @brief The number of references redirected through a pool.
+    [[nodiscard]] size_t getRedirectedCount() const
+    {
+        return redirected;
+    }
+
+    [[nodiscard]] size_t getPoolCount() const
+    {
+        return pools.size();
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_ADDRESSLAYOUT_H
@@ -0,0 +1 @@
+#include "ArithmeticOpCode.h"
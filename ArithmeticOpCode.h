@@ -0,0 +1,635 @@
+#ifndef LC3_LANGUAGE_EXTENDER_ARITHMETICOPCODE_H
+#define LC3_LANGUAGE_EXTENDER_ARITHMETICOPCODE_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "PseudoOpCode.h"
+
+/// @brief Lowers arithmetic on 16-bit constants and registers to the shortest LC3 sequences it knows of:
+///   LOAD_CONSTANT Rd, #k      Rd = k
+///   ADD_CONSTANT Rd, Rs, #k   Rd = Rs + k
+///   MULTIPLY Rd, Rs, #k|Rt    Rd = Rs * k, or Rs * Rt
+///   DIVIDE Rd, Rs, #k|Rt      Rd = Rs / k, or Rs / Rt, rounded towards zero
+///   MOD Rd, Rs, #k|Rt         Rd = the remainder of that division, which takes the sign of Rs
+/// Constants may be written in any format and are taken modulo 2^16. Constants which do not fit an immediate are
+/// loaded from a literal pool at the end of the program, and multiplication by a constant is unrolled into doublings
+/// and additions. Multiplication and division of registers, and division by constants other than 1 and -1, call
+/// subroutines shared by the whole program, which pass their operands and results in memory and preserve every
+/// register. Dividing by zero gives a quotient of 0 and leaves the dividend as the remainder. Like ADD, every one of
+/// them leaves the condition codes set from the result.
+class ArithmeticOpCode final : public PseudoOpCode
+{
+private:
+    enum class Operation
+    {
+        LoadConstant,
+        AddConstant,
+        Multiply,
+        Divide,
+        Modulo,
+    };
+
+    /// @brief An ADD immediate holds 5 bits.
+    static constexpr int32_t MINIMUM_IMMEDIATE = -16;
+    static constexpr int32_t MAXIMUM_IMMEDIATE = 15;
+
+    // Mnemonics, by Operation.
+    std::array<SymbolId, 5>      mnemonics{NO_SYMBOL, NO_SYMBOL, NO_SYMBOL, NO_SYMBOL, NO_SYMBOL};
+    // The literal pool, by value, so it reads the same however the program uses it.
+    std::map<uint16_t, SymbolId> constants;
+    // Memory the subroutines and their callers share, and where scratch registers are kept when none is free.
+    SymbolId                     leftOperand          = NO_SYMBOL;
+    SymbolId                     rightOperand         = NO_SYMBOL;
+    SymbolId                     resultLocation       = NO_SYMBOL;
+    SymbolId                     remainderLocation    = NO_SYMBOL;
+    SymbolId                     temporarySave        = NO_SYMBOL;
+    SymbolId                     returnAddressSave    = NO_SYMBOL;
+    SymbolId                     multiplySubroutine   = NO_SYMBOL;
+    SymbolId                     divideSubroutine     = NO_SYMBOL;
+    std::array<SymbolId, 7>      registerSaves{NO_SYMBOL, NO_SYMBOL, NO_SYMBOL, NO_SYMBOL, NO_SYMBOL, NO_SYMBOL,
+                                               NO_SYMBOL};
+    bool                         multiplying          = false;
+    bool                         dividing             = false;
+    bool                         savingTemporary      = false;
+    bool                         savingReturnAddress  = false;
+
+    void resolveMnemonics()
+    {
+        if (mnemonics[0] != NO_SYMBOL) {
+            return;
+        }
+        auto& symbols = getSymbolTable();
+        mnemonics     = {symbols.intern("LOAD_CONSTANT"), symbols.intern("ADD_CONSTANT"), symbols.intern("MULTIPLY"),
+                         symbols.intern("DIVIDE"), symbols.intern("MOD")};
+        leftOperand        = symbols.generate("__arithmetic_impl_left");
+        rightOperand       = symbols.generate("__arithmetic_impl_right");
+        resultLocation     = symbols.generate("__arithmetic_impl_result");
+        remainderLocation  = symbols.generate("__arithmetic_impl_remainder");
+        temporarySave      = symbols.generate("__arithmetic_impl_temp_save_location");
+        returnAddressSave  = symbols.generate("__arithmetic_impl_return_address");
+        multiplySubroutine = symbols.generate("__arithmetic_impl_multiply");
+        divideSubroutine   = symbols.generate("__arithmetic_impl_divide");
+        for (int r = 0; r < 7; r++) {
+            registerSaves[r] = symbols.generate("__arithmetic_impl_save_R" + std::to_string(r));
+        }
+    }
+
+    [[nodiscard]] std::optional<Operation> findOperation(const Instruction& token)
+    {
+        resolveMnemonics();
+        if (token.opcode != Opcode::PSEUDO) {
+            return std::nullopt;
+        }
+        for (size_t i = 0; i < mnemonics.size(); i++) {
+            if (token.mnemonic == mnemonics[i]) {
+                return static_cast<Operation>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// @brief The constant operand of a token, as the 16-bit value it stands for.
+    static int16_t constantOf(const Instruction& token)
+    {
+        return static_cast<int16_t>(static_cast<uint16_t>(token.immediate));
+    }
+
+    static bool fitsImmediate(int32_t value)
+    {
+        return value >= MINIMUM_IMMEDIATE && value <= MAXIMUM_IMMEDIATE;
+    }
+
+    static Instruction addImmediate(int destinationRegister, int sourceRegister, int32_t value)
+    {
+        return Instruction::create(Opcode::ADD, {destinationRegister, sourceRegister}).withImmediate(value);
+    }
+
+    static Instruction add(int destinationRegister, int left, int right)
+    {
+        return Instruction::create(Opcode::ADD, {destinationRegister, left, right});
+    }
+
+    static Instruction clear(int destinationRegister)
+    {
+        return Instruction::create(Opcode::AND, {destinationRegister, destinationRegister}).withImmediate(0);
+    }
+
+    /// @brief NOT and ADD #1, leaving the negated source in the destination.
+    static void appendNegation(std::vector<Instruction>& out, int destinationRegister, int sourceRegister)
+    {
+        out.push_back(Instruction::create(Opcode::NOT, {destinationRegister, sourceRegister}));
+        out.push_back(addImmediate(destinationRegister, destinationRegister, 1));
+    }
+
+    /// @brief The immediates of the ADDs adding value one immediate at a time.
+    static std::vector<int32_t> splitIntoImmediates(int32_t value)
+    {
+        std::vector<int32_t> steps;
+        int32_t              step = value < 0 ? MINIMUM_IMMEDIATE : MAXIMUM_IMMEDIATE;
+        while (!fitsImmediate(value)) {
+            steps.push_back(step);
+            value -= step;
+        }
+        steps.push_back(value);
+        return steps;
+    }
+
+    /// @brief The pool entry holding value, added on first use.
+    SymbolId getConstant(int16_t value)
+    {
+        auto word = static_cast<uint16_t>(value);
+        if (auto it = constants.find(word); it != constants.end()) {
+            return it->second;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "__constant_impl_x%04X", static_cast<unsigned>(word));
+        return constants.emplace(word, getSymbolTable().generate(name)).first->second;
+    }
+
+    Instruction loadConstant(int destinationRegister, int16_t value)
+    {
+        return Instruction::create(Opcode::LD, {destinationRegister}).withLabel(getConstant(value));
+    }
+
+    /// @brief Finds a register the sequence may overwrite besides the destination, which has to be saved and restored
+    /// around it if the second value is true.
+    std::pair<int, bool> chooseTempRegister(RegisterSet excluded)
+    {
+        excluded |= getReservedRegisters();
+        if (auto deadRegister = findDeadRegister(excluded, 0)) {
+            return {*deadRegister, false};
+        }
+        int tempRegister = 0;
+        while (excluded & registerBit(tempRegister)) {
+            tempRegister++;
+        }
+        return {tempRegister, true};
+    }
+
+    /// @brief Wraps the sequence in a save and restore of the temp register, if it has to be preserved. The restore
+    /// sets the condition codes, so they are set from the destination again after it.
+    std::vector<Instruction> preserving(int tempRegister, bool preserve, int destinationRegister,
+                                        std::vector<Instruction> sequence)
+    {
+        if (!preserve) {
+            return sequence;
+        }
+        savingTemporary = true;
+        sequence.insert(sequence.begin(), Instruction::create(Opcode::ST, {tempRegister}).withLabel(temporarySave));
+        sequence.push_back(Instruction::create(Opcode::LD, {tempRegister}).withLabel(temporarySave));
+        sequence.push_back(addImmediate(destinationRegister, destinationRegister, 0));
+        return sequence;
+    }
+
+    std::vector<Instruction> handleLoadConstant(int destinationRegister, int16_t value)
+    {
+        // AND R${DESTINATION_REGISTER}, R${DESTINATION_REGISTER}, #0
+        // Or:  LD R${DESTINATION_REGISTER}, ${CONSTANT}
+        if (value == 0) {
+            return {clear(destinationRegister)};
+        }
+        return {loadConstant(destinationRegister, value)};
+    }
+
+    std::vector<Instruction> handleAddConstant(int destinationRegister, int sourceRegister, int16_t value)
+    {
+        // A run of ADD immediates, or the constant loaded from the pool and added.
+        // ADD R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, #${PART}
+        // ADD R${DESTINATION_REGISTER}, R${DESTINATION_REGISTER}, #${PART}   ...
+        // Or:  LD R${TEMP_REGISTER}, ${CONSTANT}
+        //      ADD R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, R${TEMP_REGISTER}
+        auto steps = splitIntoImmediates(value);
+        int  tempRegister = destinationRegister;
+        bool preserve     = false;
+        if (destinationRegister == sourceRegister) {
+            std::tie(tempRegister, preserve) = chooseTempRegister(registerBit(sourceRegister));
+        }
+        size_t pooledLength = preserve ? 5 : 2;
+        if (steps.size() <= pooledLength) {
+            std::vector<Instruction> sequence;
+            for (size_t i = 0; i < steps.size(); i++) {
+                sequence.push_back(addImmediate(destinationRegister, i == 0 ? sourceRegister : destinationRegister,
+                                                steps[i]));
+            }
+            return sequence;
+        }
+        return preserving(tempRegister, preserve, destinationRegister,
+                          {loadConstant(tempRegister, value), add(destinationRegister, sourceRegister, tempRegister)});
+    }
+
+    /// @brief The doublings and additions multiplying by a positive factor, from its highest bit down.
+    static size_t multiplicationLength(uint16_t factor)
+    {
+        return std::bit_width(factor) - 1 + std::popcount(factor) - 1;
+    }
+
+    std::vector<Instruction> handleConstantMultiplication(int destinationRegister, int sourceRegister, int16_t value)
+    {
+        // Shift and add, from the highest bit of the factor down:
+        // ADD R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, R${SOURCE_REGISTER}   (doubling)
+        // ADD R${DESTINATION_REGISTER}, R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}   (for a set bit)
+        // ...
+        // NOT R${DESTINATION_REGISTER}, R${DESTINATION_REGISTER}   (for a negated factor)
+        // ADD R${DESTINATION_REGISTER}, R${DESTINATION_REGISTER}, #1
+        if (value == 0) {
+            return {clear(destinationRegister)};
+        }
+        auto factor  = static_cast<uint16_t>(value);
+        auto negated = static_cast<uint16_t>(-factor);
+        bool negate  = negated != 0 && multiplicationLength(negated) + 2 < multiplicationLength(factor);
+        if (negate) {
+            factor = negated;
+        }
+
+        std::vector<Instruction> sequence;
+        if (factor == 1) {
+            if (negate) {
+                appendNegation(sequence, destinationRegister, sourceRegister);
+                return sequence;
+            }
+            return {addImmediate(destinationRegister, sourceRegister, 0)};
+        }
+        // The source is read after the destination is first written, unless the factor is a power of two.
+        int  multiplicand = sourceRegister;
+        int  tempRegister = 0;
+        bool preserve     = false;
+        if (destinationRegister == sourceRegister && std::popcount(factor) > 1) {
+            std::tie(tempRegister, preserve) = chooseTempRegister(registerBit(sourceRegister));
+            multiplicand = tempRegister;
+            sequence.push_back(addImmediate(tempRegister, sourceRegister, 0));
+        }
+        for (int bit = std::bit_width(factor) - 2; bit >= 0; bit--) {
+            bool first = bit == std::bit_width(factor) - 2;
+            sequence.push_back(first ? add(destinationRegister, multiplicand, multiplicand)
+                                     : add(destinationRegister, destinationRegister, destinationRegister));
+            if (factor & 1 << bit) {
+                sequence.push_back(add(destinationRegister, destinationRegister, multiplicand));
+            }
+        }
+        if (negate) {
+            appendNegation(sequence, destinationRegister, destinationRegister);
+        }
+        return preserving(tempRegister, preserve, destinationRegister, std::move(sequence));
+    }
+
+    /// @brief JSR ${subroutine}, saving and restoring R7 around it if it is live.
+    std::vector<Instruction> createCall(SymbolId subroutine, int destinationRegister)
+    {
+        auto call = Instruction::create(Opcode::JSR).withLabel(subroutine);
+        if (!(getLiveRegisters() & ~registerBit(destinationRegister) & registerBit(7))) {
+            return {call};
+        }
+        savingReturnAddress = true;
+        return {Instruction::create(Opcode::ST, {7}).withLabel(returnAddressSave), call,
+                Instruction::create(Opcode::LD, {7}).withLabel(returnAddressSave)};
+    }
+
+    std::vector<Instruction> handleCall(Operation operation, const Instruction& token)
+    {
+        // ST R${SOURCE_REGISTER}, ${LEFT}
+        // ST R${RIGHT_REGISTER}, ${RIGHT}       (or LOAD_CONSTANT R${DESTINATION_REGISTER}, #${VALUE} and a ST of it)
+        // JSR ${SUBROUTINE}
+        // LD R${DESTINATION_REGISTER}, ${RESULT}
+        int destinationRegister = token.registers[0];
+        std::vector<Instruction> sequence{Instruction::create(Opcode::ST, {token.registers[1]}).withLabel(leftOperand)};
+        int rightRegister = token.registers[2];
+        if (token.hasImmediate()) {
+            rightRegister = destinationRegister;
+            sequence.push_back(Instruction::pseudo(mnemonics[static_cast<size_t>(Operation::LoadConstant)],
+                                                   {rightRegister}).withImmediate(constantOf(token)));
+        }
+        sequence.push_back(Instruction::create(Opcode::ST, {rightRegister}).withLabel(rightOperand));
+
+        auto subroutine = operation == Operation::Multiply ? multiplySubroutine : divideSubroutine;
+        (operation == Operation::Multiply ? multiplying : dividing) = true;
+        auto call = createCall(subroutine, destinationRegister);
+        sequence.insert(sequence.end(), call.begin(), call.end());
+        sequence.push_back(Instruction::create(Opcode::LD, {destinationRegister})
+                                   .withLabel(operation == Operation::Modulo ? remainderLocation : resultLocation));
+        return sequence;
+    }
+
+    std::vector<Instruction> handleDivision(Operation operation, const Instruction& token)
+    {
+        int destinationRegister = token.registers[0];
+        int sourceRegister      = token.registers[1];
+        if (token.hasImmediate() && (constantOf(token) == 1 || constantOf(token) == -1)) {
+            // Dividing by 1 or -1 leaves no remainder, and the quotient is the dividend or its negation.
+            if (operation == Operation::Modulo) {
+                return {clear(destinationRegister)};
+            }
+            if (constantOf(token) == 1) {
+                return {addImmediate(destinationRegister, sourceRegister, 0)};
+            }
+            std::vector<Instruction> sequence;
+            appendNegation(sequence, destinationRegister, sourceRegister);
+            return sequence;
+        }
+        return handleCall(operation, token);
+    }
+
+    /// @brief Saves the registers a subroutine uses, runs its body and restores them.
+    std::vector<Instruction> createSubroutine(SymbolId label, int registerCount, std::vector<Instruction> body)
+    {
+        std::vector<Instruction> subroutine;
+        for (int r = 0; r < registerCount; r++) {
+            subroutine.push_back(Instruction::create(Opcode::ST, {r}).withLabel(registerSaves[r]));
+        }
+        subroutine.front() = subroutine.front().withDefinedLabel(label);
+        subroutine.insert(subroutine.end(), body.begin(), body.end());
+        for (int r = 0; r < registerCount; r++) {
+            subroutine.push_back(Instruction::create(Opcode::LD, {r}).withLabel(registerSaves[r]));
+        }
+        subroutine.push_back(Instruction::create(Opcode::RET));
+        return subroutine;
+    }
+
+    static Instruction branch(uint8_t conditionFlags, SymbolId label)
+    {
+        auto instruction           = Instruction::create(Opcode::BR).withLabel(label);
+        instruction.conditionFlags = conditionFlags;
+        return instruction;
+    }
+
+    /// @brief Multiplies left by right modulo 2^16, from the highest bit of right down.
+    std::vector<Instruction> createMultiplySubroutine()
+    {
+        // R0: multiplicand, R1: multiplier, shifted left, R2: product, R3: bits left
+        auto& symbols = getSymbolTable();
+        auto  loop    = symbols.generate("__arithmetic_impl_multiply_loop");
+        auto  skip    = symbols.generate("__arithmetic_impl_multiply_skip");
+        return createSubroutine(multiplySubroutine, 4, {
+                Instruction::create(Opcode::LD, {0}).withLabel(leftOperand),
+                Instruction::create(Opcode::LD, {1}).withLabel(rightOperand),
+                clear(2),
+                clear(3),
+                addImmediate(3, 3, 8),
+                addImmediate(3, 3, 8),
+                add(2, 2, 2).withDefinedLabel(loop),
+                addImmediate(1, 1, 0),
+                branch(CONDITION_Z | CONDITION_P, skip),
+                add(2, 2, 0),
+                add(1, 1, 1).withDefinedLabel(skip),
+                addImmediate(3, 3, -1),
+                branch(CONDITION_P, loop),
+                Instruction::create(Opcode::ST, {2}).withLabel(resultLocation),
+        });
+    }
+
+    /// @brief Divides left by right, rounding towards zero, by long division of their magnitudes.
+    std::vector<Instruction> createDivideSubroutine()
+    {
+        // R0: dividend magnitude, shifted left, R1: divisor magnitude, R2: quotient, R3: remainder, R4: scratch,
+        // R5: negated divisor magnitude, R6: bits left
+        // As magnitudes go up to 2^15, the remainder is compared with the divisor as unsigned numbers: a remainder of
+        // 2^15 or more is at least the divisor, and a divisor of 2^15 is more than any smaller remainder.
+        auto& symbols          = getSymbolTable();
+        auto  dividendPositive = symbols.generate("__arithmetic_impl_divide_dividend_positive");
+        auto  divisorPositive  = symbols.generate("__arithmetic_impl_divide_divisor_positive");
+        auto  loop             = symbols.generate("__arithmetic_impl_divide_loop");
+        auto  shift            = symbols.generate("__arithmetic_impl_divide_shift");
+        auto  subtract         = symbols.generate("__arithmetic_impl_divide_subtract");
+        auto  next             = symbols.generate("__arithmetic_impl_divide_next");
+        auto  remainderSigned  = symbols.generate("__arithmetic_impl_divide_remainder_signed");
+        auto  quotientSigned   = symbols.generate("__arithmetic_impl_divide_quotient_signed");
+        auto  byZero           = symbols.generate("__arithmetic_impl_divide_by_zero");
+
+        std::vector<Instruction> body{
+                Instruction::create(Opcode::LD, {0}).withLabel(leftOperand),
+                branch(CONDITION_Z | CONDITION_P, dividendPositive),
+                Instruction::create(Opcode::NOT, {0, 0}),
+                addImmediate(0, 0, 1),
+                Instruction::create(Opcode::LD, {1}).withLabel(rightOperand).withDefinedLabel(dividendPositive),
+                branch(CONDITION_Z, byZero),
+                branch(CONDITION_P, divisorPositive),
+                Instruction::create(Opcode::NOT, {1, 1}),
+                addImmediate(1, 1, 1),
+                Instruction::create(Opcode::NOT, {5, 1}).withDefinedLabel(divisorPositive),
+                addImmediate(5, 5, 1),
+                clear(2),
+                clear(3),
+                clear(6),
+                addImmediate(6, 6, 8),
+                addImmediate(6, 6, 8),
+                add(2, 2, 2).withDefinedLabel(loop),
+                add(3, 3, 3),
+                addImmediate(0, 0, 0),
+                branch(CONDITION_Z | CONDITION_P, shift),
+                addImmediate(3, 3, 1),
+                add(0, 0, 0).withDefinedLabel(shift),
+                addImmediate(3, 3, 0),
+                branch(CONDITION_N, subtract),
+                addImmediate(1, 1, 0),
+                branch(CONDITION_N, next),
+                add(4, 3, 5),
+                branch(CONDITION_N, next),
+                add(3, 3, 5).withDefinedLabel(subtract),
+                addImmediate(2, 2, 1),
+                addImmediate(6, 6, -1).withDefinedLabel(next),
+                branch(CONDITION_P, loop),
+                // The remainder takes the sign of the dividend, and the quotient is negative if exactly one of the
+                // operands is.
+                Instruction::create(Opcode::LD, {0}).withLabel(leftOperand),
+                branch(CONDITION_Z | CONDITION_P, remainderSigned),
+        };
+        appendNegation(body, 3, 3);
+        appendNegation(body, 2, 2);
+        body.push_back(Instruction::create(Opcode::LD, {1}).withLabel(rightOperand).withDefinedLabel(remainderSigned));
+        body.push_back(branch(CONDITION_Z | CONDITION_P, quotientSigned));
+        appendNegation(body, 2, 2);
+        body.push_back(branch(CONDITION_N | CONDITION_Z | CONDITION_P, quotientSigned));
+        body.push_back(clear(2).withDefinedLabel(byZero));
+        body.push_back(Instruction::create(Opcode::LD, {3}).withLabel(leftOperand));
+        body.push_back(
+                Instruction::create(Opcode::ST, {2}).withLabel(resultLocation).withDefinedLabel(quotientSigned));
+        body.push_back(Instruction::create(Opcode::ST, {3}).withLabel(remainderLocation));
+        return createSubroutine(divideSubroutine, 7, std::move(body));
+    }
+
+public:
+    static constexpr std::string_view                NAME      = "ARITHMETIC";
+    static constexpr int                             PRIORITY  = 0;
+    static constexpr std::array<std::string_view, 5> MNEMONICS = {"LOAD_CONSTANT", "ADD_CONSTANT", "MULTIPLY", "DIVIDE",
+                                                                  "MOD"};
+
+    [[nodiscard]] std::string getName() override
+    {
+        return std::string(NAME);
+    }
+
+    [[nodiscard]] std::vector<std::string> getInitializationLogic() override
+    {
+        return {};
+    }
+
+    [[nodiscard]] std::vector<Instruction> getFileEndInstructions() override
+    {
+        std::vector<Instruction> result;
+        if (multiplying) {
+            auto subroutine = createMultiplySubroutine();
+            result.insert(result.end(), subroutine.begin(), subroutine.end());
+        }
+        if (dividing) {
+            auto subroutine = createDivideSubroutine();
+            result.insert(result.end(), subroutine.begin(), subroutine.end());
+        }
+        auto fill = [&](SymbolId label, int32_t value) {
+            result.push_back(Instruction::create(Opcode::FILL)
+                                     .withImmediate(value, ImmediateFormat::Hexadecimal)
+                                     .withDefinedLabel(label));
+        };
+        if (multiplying || dividing) {
+            // ${leftOperand} .FILL x0   ...and the right operand, results and register saves
+            fill(leftOperand, 0);
+            fill(rightOperand, 0);
+            fill(resultLocation, 0);
+            if (dividing) {
+                fill(remainderLocation, 0);
+            }
+            for (int r = 0; r < (dividing ? 7 : 4); r++) {
+                fill(registerSaves[r], 0);
+            }
+        }
+        if (savingTemporary) {
+            fill(temporarySave, 0);
+        }
+        if (savingReturnAddress) {
+            fill(returnAddressSave, 0);
+        }
+        for (auto& [value, label]: constants) {
+            // ${CONSTANT} .FILL x${VALUE}
+            fill(label, value);
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::vector<std::string> getFileEndStatements() override
+    {
+        return Instruction::formatAll(getFileEndInstructions(), getSymbolTable());
+    }
+
+    [[nodiscard]] std::vector<std::string> getMnemonics() override
+    {
+        return {MNEMONICS.begin(), MNEMONICS.end()};
+    }
+
+    [[nodiscard]] int getPriority() override
+    {
+        return PRIORITY;
+    }
+
+    [[nodiscard]] bool canHandle(const Instruction& token) override
+    {
+        // Form: LOAD_CONSTANT R${DESTINATION_REGISTER}, #${VALUE}
+        // Or:  ${OPERATION} R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, #${VALUE}
+        // Or:  ${OPERATION} R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, R${SOURCE_REGISTER}, except ADD_CONSTANT
+        auto operation = findOperation(token);
+        if (!operation || token.label != NO_SYMBOL || token.hasString()) {
+            return false;
+        }
+        if (*operation == Operation::LoadConstant) {
+            return token.registerCount == 1 && token.hasImmediate();
+        }
+        if (token.registerCount == 3) {
+            return *operation != Operation::AddConstant && !token.hasImmediate();
+        }
+        return token.registerCount == 2 && token.hasImmediate();
+    }
+
+    [[nodiscard]] std::vector<Instruction> handleToken(const Instruction& token) override
+    {
+        switch (*findOperation(token)) {
+            case Operation::LoadConstant:
+                return handleLoadConstant(token.registers[0], constantOf(token));
+            case Operation::AddConstant:
+                return handleAddConstant(token.registers[0], token.registers[1], constantOf(token));
+            case Operation::Multiply:
+                if (token.hasImmediate()) {
+                    return handleConstantMultiplication(token.registers[0], token.registers[1], constantOf(token));
+                }
+                return handleCall(Operation::Multiply, token);
+            case Operation::Divide:
+                return handleDivision(Operation::Divide, token);
+            case Operation::Modulo:
+                return handleDivision(Operation::Modulo, token);
+        }
+        return {};
+    }
+
+    /// @brief Reads the source registers and overwrites the destination; everything else is preserved.
+    [[nodiscard]] RegisterEffects getRegisterEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return RegisterEffects::unknown();
+        }
+        RegisterEffects effects;
+        for (int i = 1; i < token.registerCount; i++) {
+            effects.reads |= registerBit(token.registers[i]);
+        }
+        effects.writes = registerBit(token.registers[0]);
+        return effects;
+    }
+
+    /// @brief Scratch registers are saved in memory rather than on a stack.
+    [[nodiscard]] std::optional<std::vector<StackEffect>> getStackEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return std::nullopt;
+        }
+        return std::vector<StackEffect>();
+    }
+
+    /// @brief An expansion only depends on the token and the registers around it; the pool is named by value.
+    [[nodiscard]] bool isCacheable(const Instruction& token) override
+    {
+        return canHandle(token);
+    }
+
+    /// @brief Records the constants, subroutines and save locations the expansion uses. Which of them it uses depends
+    /// on the registers live around the token, so the expansion is built again against them and dropped.
+    void replayToken(const Instruction& token) override
+    {
+        static_cast<void>(handleToken(token));
+    }
+
+    [[nodiscard]] std::unique_ptr<PseudoOpCode> clone() const override
+    {
+        return std::make_unique<ArithmeticOpCode>(*this);
+    }
+
+    /// @brief Adds the constants the clone pooled, and emits whatever it used.
+    void merge(PseudoOpCode& clone, SymbolRemap& symbols) override
+    {
+        auto& other = static_cast<ArithmeticOpCode&>(clone);
+        for (auto [value, label]: other.constants) {
+            constants.emplace(value, symbols(label));
+        }
+        multiplying |= other.multiplying;
+        dividing |= other.dividing;
+        savingTemporary |= other.savingTemporary;
+        savingReturnAddress |= other.savingReturnAddress;
+    }
+
+    [[nodiscard]] bool canHandle(const std::string& token) override
+    {
+        return canHandle(Instruction::parse(token, getSymbolTable()));
+    }
+
+    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    {
+        return Instruction::formatAll(handleToken(Instruction::parse(token, getSymbolTable())), getSymbolTable());
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_ARITHMETICOPCODE_H
@@ -0,0 +1 @@
+#include "Assembler.h"
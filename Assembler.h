@@ -0,0 +1,278 @@
+#ifndef LC3_LANGUAGE_EXTENDER_ASSEMBLER_H
+#define LC3_LANGUAGE_EXTENDER_ASSEMBLER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Instruction.h"
+#include "SymbolTable.h"
+
+/// @brief The words of an assembled program, loaded at origin.
+struct MemoryImage
+{
+    uint16_t              origin = 0;
+    std::vector<uint16_t> words;
+    /// @brief The index of the program line each word was assembled from.
+    std::vector<size_t>   lines;
+};
+
+/// @brief Assembles the expanded program into LC3 machine code, in two passes: the first assigns every line its
+/// address, the second encodes it. Only the lines between .ORIG and .END are assembled.
+class Assembler
+{
+private:
+    static constexpr int32_t MEMORY_SIZE = 0x10000;
+
+    const SymbolTable&                     symbols;
+    std::unordered_map<SymbolId, uint16_t> labels;
+
+    [[noreturn]] void fail(const std::string& reason, const Instruction& line) const
+    {
+        throw std::runtime_error(reason + ": " + line.toString(symbols));
+    }
+
+    [[nodiscard]] int32_t sizeOf(const Instruction& line) const
+    {
+        switch (line.opcode) {
+            case Opcode::ORIG:
+            case Opcode::END:
+            case Opcode::LABEL:
+                return 0;
+            case Opcode::BLKW:
+                return std::max(line.immediate, 0);
+            case Opcode::STRINGZ:
+                return static_cast<int32_t>(Instruction::decodeString(symbols.getName(line.label)).size() + 1);
+            default:
+                return 1;
+        }
+    }
+
+    /// @brief The value of a register field.
+    static uint16_t field(int value, int shift)
+    {
+        return static_cast<uint16_t>((value & 0x7) << shift);
+    }
+
+    /// @brief Checks that value fits in a two's complement field of the given width, and returns its bits.
+    uint16_t signedField(int32_t value, int bits, const Instruction& line) const
+    {
+        int32_t limit = 1 << (bits - 1);
+        if (value < -limit || value >= limit) {
+            fail("Operand out of range (" + std::to_string(value) + " does not fit in " + std::to_string(bits) +
+                 " bits)", line);
+        }
+        return static_cast<uint16_t>(value & ((1 << bits) - 1));
+    }
+
+    /// @brief The PC-relative offset of the operand of a line at address, in a field of the given width.
+    uint16_t offsetField(const Instruction& line, int32_t address, int bits) const
+    {
+        if (line.hasImmediate()) {
+            return signedField(line.immediate, bits, line);
+        }
+        return signedField(resolve(line) - (address + 1), bits, line);
+    }
+
+    [[nodiscard]] int32_t resolve(const Instruction& line) const
+    {
+        auto it = labels.find(line.label);
+        if (it == labels.end()) {
+            fail("Undefined label " + symbols.getName(line.label), line);
+        }
+        return it->second;
+    }
+
+    static uint16_t trap(int vector)
+    {
+        return static_cast<uint16_t>(0xF000 | vector);
+    }
+
+    uint16_t encode(const Instruction& line, int32_t address) const
+    {
+        auto& r = line.registers;
+        switch (line.opcode) {
+            case Opcode::ADD:
+            case Opcode::AND: {
+                uint16_t word = (line.opcode == Opcode::ADD ? 0x1000 : 0x5000) | field(r[0], 9) | field(r[1], 6);
+                if (line.registerCount == 3) {
+                    return word | field(r[2], 0);
+                }
+                return word | 0x20 | signedField(line.immediate, 5, line);
+            }
+            case Opcode::NOT:
+                return 0x903F | field(r[0], 9) | field(r[1], 6);
+            case Opcode::BR: {
+                // A plain BR branches always.
+                int flags = line.conditionFlags == 0 ? CONDITION_N | CONDITION_Z | CONDITION_P : line.conditionFlags;
+                return field(flags, 9) | offsetField(line, address, 9);
+            }
+            case Opcode::JMP:
+                return 0xC000 | field(r[0], 6);
+            case Opcode::RET:
+                return 0xC1C0;
+            case Opcode::JSR:
+                return 0x4800 | offsetField(line, address, 11);
+            case Opcode::JSRR:
+                return 0x4000 | field(r[0], 6);
+            case Opcode::LD:
+                return 0x2000 | field(r[0], 9) | offsetField(line, address, 9);
+            case Opcode::LDI:
+                return 0xA000 | field(r[0], 9) | offsetField(line, address, 9);
+            case Opcode::LEA:
+                return 0xE000 | field(r[0], 9) | offsetField(line, address, 9);
+            case Opcode::ST:
+                return 0x3000 | field(r[0], 9) | offsetField(line, address, 9);
+            case Opcode::STI:
+                return 0xB000 | field(r[0], 9) | offsetField(line, address, 9);
+            case Opcode::LDR:
+                return 0x6000 | field(r[0], 9) | field(r[1], 6) | signedField(line.immediate, 6, line);
+            case Opcode::STR:
+                return 0x7000 | field(r[0], 9) | field(r[1], 6) | signedField(line.immediate, 6, line);
+            case Opcode::TRAP:
+                if (line.immediate < 0 || line.immediate > 0xFF) {
+                    fail("Trap vector out of range", line);
+                }
+                return trap(line.immediate);
+            case Opcode::RTI:
+                return 0x8000;
+            case Opcode::GETC:
+                return trap(0x20);
+            case Opcode::OUT:
+                return trap(0x21);
+            case Opcode::PUTS:
+                return trap(0x22);
+            case Opcode::IN:
+                return trap(0x23);
+            case Opcode::PUTSP:
+                return trap(0x24);
+            case Opcode::HALT:
+                return trap(0x25);
+            case Opcode::FILL:
+                return static_cast<uint16_t>(line.hasImmediate() ? line.immediate : resolve(line));
+            default:
+                fail("Unable to assemble", line);
+        }
+    }
+
+public:
+    explicit Assembler(const SymbolTable& symbols) : symbols(symbols)
+    {
+    }
+
+    /// @brief Assembles the program. Throws std::runtime_error, naming the line concerned, if a line is not an LC3
+    /// instruction or directive, a label is undefined or an operand does not fit its field.
+    MemoryImage assemble(const std::vector<Instruction>& program)
+    {
+        size_t first = 0;
+        while (first < program.size() && program[first].opcode != Opcode::ORIG) {
+            first++;
+        }
+        if (first == program.size()) {
+            throw std::runtime_error("No .ORIG directive found.");
+        }
+
+        // Pass one: addresses.
+        labels.clear();
+        std::vector<int32_t> addresses(program.size(), 0);
+        int32_t              address = program[first].immediate;
+        size_t               last    = first;
+        for (; last < program.size() && program[last].opcode != Opcode::END; last++) {
+            auto& line = program[last];
+            addresses[last] = address;
+            if (line.definedLabel != NO_SYMBOL && !labels.emplace(line.definedLabel, address).second) {
+                fail("Duplicate label " + symbols.getName(line.definedLabel), line);
+            }
+            address += sizeOf(line);
+            if (address > MEMORY_SIZE) {
+                fail("The program runs past xFFFF", line);
+            }
+        }
+
+        // Pass two: words.
+        MemoryImage image;
+        image.origin = static_cast<uint16_t>(program[first].immediate);
+        image.words.reserve(address - image.origin);
+        image.lines.reserve(address - image.origin);
+        for (size_t i = first + 1; i < last; i++) {
+            auto& line = program[i];
+            switch (line.opcode) {
+                case Opcode::LABEL:
+                    continue;
+                case Opcode::BLKW:
+                    image.words.insert(image.words.end(), sizeOf(line), 0);
+                    break;
+                case Opcode::STRINGZ:
+                    for (char c: Instruction::decodeString(symbols.getName(line.label))) {
+                        image.words.push_back(static_cast<unsigned char>(c));
+                    }
+                    image.words.push_back(0);
+                    break;
+                case Opcode::ORIG:
+                    fail("Only one .ORIG block can be assembled", line);
+                default:
+                    image.words.push_back(encode(line, addresses[i]));
+                    break;
+            }
+            image.lines.resize(image.words.size(), i);
+        }
+        return image;
+    }
+
+    /// @brief The address of every label of the last program assembled.
+    [[nodiscard]] const std::unordered_map<SymbolId, uint16_t>& getLabels() const
+    {
+        return labels;
+    }
+
+    /// @brief Writes the image as an LC3 object file, as produced by lc3as: the origin followed by every word, each
+    /// big-endian.
+    static void writeObject(const MemoryImage& image, std::ostream& output)
+    {
+        std::string bytes;
+        bytes.reserve(2 * (image.words.size() + 1));
+        auto append = [&](uint16_t word) {
+            bytes += static_cast<char>(word >> 8);
+            bytes += static_cast<char>(word & 0xFF);
+        };
+        append(image.origin);
+        for (auto word: image.words) {
+            append(word);
+        }
+        output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        output.flush();
+    }
+
+    /// @brief Writes the labels of the last program assembled as an lc3as symbol file, ordered by address.
+    void writeSymbols(std::ostream& output) const
+    {
+        std::vector<std::pair<uint16_t, std::string>> ordered;
+        ordered.reserve(labels.size());
+        for (auto& [label, address]: labels) {
+            ordered.emplace_back(address, symbols.getName(label));
+        }
+        std::sort(ordered.begin(), ordered.end());
+
+        output << "// Symbol table\n";
+        output << "// Scope level 0:\n";
+        output << "//\tSymbol Name       Page Address\n";
+        output << "//\t----------------  ------------\n";
+        char address[8];
+        for (auto& [value, name]: ordered) {
+            std::snprintf(address, sizeof(address), "%04X", value);
+            output << "//\t" << name << std::string(name.size() < 16 ? 16 - name.size() : 0, ' ') << "  " << address
+                   << "\n";
+        }
+        output << "\n";
+        output.flush();
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_ASSEMBLER_H
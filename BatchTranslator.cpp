@@ -0,0 +1 @@
+#include "BatchTranslator.h"
@@ -0,0 +1,181 @@
+#ifndef LC3_LANGUAGE_EXTENDER_BATCHTRANSLATOR_H
+#define LC3_LANGUAGE_EXTENDER_BATCHTRANSLATOR_H
+
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "BuiltinPseudoOpCodes.h"
+#include "SourceBuffer.h"
+#include "Translator.h"
+#include "WorkStealingPool.h"
+
+/// @brief Translates many files concurrently, each with its own Translator and PseudoOpCode instances.
+class BatchTranslator
+{
+public:
+    struct Result
+    {
+        std::filesystem::path input;
+        std::filesystem::path output;
+        bool                  success      = false;
+        std::string           error;
+        double                milliseconds = 0;
+    };
+
+private:
+    /// @brief Discards everything written to it.
+    class NullBuffer : public std::streambuf
+    {
+    protected:
+        int overflow(int c) override
+        {
+            return traits_type::not_eof(c);
+        }
+    };
+
+    std::filesystem::path outputDirectory;
+    BuiltinOptions        options;
+    bool                  streaming;
+    bool                  optimizing;
+    bool                  layingOut;
+    bool                  emittingObject;
+    size_t                threadCount;
+
+    static bool isSource(const std::filesystem::path& path)
+    {
+        return path.extension() == ".asm";
+    }
+
+    /// @brief Pairs each input file with its output path. Directories contribute every .asm file below them, keeping
+    /// their layout relative to the directory. Object files are named after their input with the extension .obj.
+    [[nodiscard]] std::vector<Result> collect(const std::vector<std::filesystem::path>& inputs) const
+    {
+        std::vector<Result> result;
+        for (auto& input: inputs) {
+            if (std::filesystem::is_directory(input)) {
+                std::vector<std::filesystem::path> files;
+                for (auto& entry: std::filesystem::recursive_directory_iterator(input)) {
+                    if (entry.is_regular_file() && isSource(entry.path())) {
+                        files.push_back(entry.path());
+                    }
+                }
+                std::sort(files.begin(), files.end());
+                for (auto& file: files) {
+                    result.push_back({file, outputDirectory / std::filesystem::relative(file, input), false, ""});
+                }
+            }
+            else {
+                result.push_back({input, outputDirectory / input.filename(), false, ""});
+            }
+        }
+        if (emittingObject) {
+            for (auto& entry: result) {
+                entry.output.replace_extension(".obj");
+            }
+        }
+        return result;
+    }
+
+    void translateFile(Result& result) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            // Streaming reads the input line by line; otherwise it is mapped into memory.
+            std::ifstream input;
+            SourceBuffer  source;
+            if (streaming) {
+                input.open(result.input);
+                if (!input) {
+                    throw std::runtime_error("Unable to open input file.");
+                }
+            }
+            else {
+                source = SourceBuffer::map(result.input);
+            }
+            std::filesystem::create_directories(result.output.parent_path());
+            std::ofstream output(result.output, emittingObject ? std::ios::binary : std::ios::out);
+            if (!output) {
+                throw std::runtime_error("Unable to open output file " + result.output.string() + ".");
+            }
+
+            NullBuffer   nullBuffer;
+            std::ostream diagnostics(&nullBuffer);
+            Translator   translator(diagnostics);
+            registerBuiltinPseudoOpCodes(translator, options);
+            translator.setOptimizing(optimizing);
+            translator.setLayingOut(layingOut);
+            if (emittingObject) {
+                std::ofstream symbolFile(std::filesystem::path(result.output).replace_extension(".sym"));
+                if (!symbolFile) {
+                    throw std::runtime_error("Unable to open the symbol file of " + result.output.string() + ".");
+                }
+                translator.assemble(source, output, &symbolFile);
+            }
+            else if (streaming) {
+                translator.translateStreaming(input, output);
+            }
+            else {
+                translator.translate(source, output);
+            }
+            result.success = true;
+        }
+        catch (const std::exception& e) {
+            result.error = e.what();
+            // Don't leave a partial translation behind.
+            std::error_code ignored;
+            std::filesystem::remove(result.output, ignored);
+            if (emittingObject) {
+                std::filesystem::remove(std::filesystem::path(result.output).replace_extension(".sym"), ignored);
+            }
+        }
+        result.milliseconds =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    BatchTranslator(std::filesystem::path outputDirectory, BuiltinOptions options, bool streaming, bool optimizing,
+                    bool layingOut, bool emittingObject, size_t threadCount)
+            : outputDirectory(std::move(outputDirectory)), options(std::move(options)), streaming(streaming),
+              optimizing(optimizing), layingOut(layingOut), emittingObject(emittingObject), threadCount(threadCount)
+    {
+    }
+
+    /// @brief Translates every input on a work-stealing pool. Results are returned in input order.
+    [[nodiscard]] std::vector<Result> translate(const std::vector<std::filesystem::path>& inputs) const
+    {
+        auto results = collect(inputs);
+        {
+            WorkStealingPool pool(threadCount);
+            for (auto& result: results) {
+                pool.submit([this, &result] { translateFile(result); });
+            }
+            pool.wait();
+        }
+        return results;
+    }
+
+    /// @brief Writes one line per file, followed by a summary.
+    static void writeReport(const std::vector<Result>& results, std::ostream& output)
+    {
+        size_t failures = 0;
+        for (auto& result: results) {
+            if (result.success) {
+                output << "OK    " << result.input.string() << " -> " << result.output.string();
+            }
+            else {
+                failures++;
+                output << "ERROR " << result.input.string() << ": " << result.error;
+            }
+            output << " (" << result.milliseconds << " ms)\n";
+        }
+        output << results.size() - failures << " of " << results.size() << " files translated.\n";
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_BATCHTRANSLATOR_H
@@ -0,0 +1,47 @@
+#ifndef LC3_LANGUAGE_EXTENDER_BUILTINPSEUDOOPCODES_H
+#define LC3_LANGUAGE_EXTENDER_BUILTINPSEUDOOPCODES_H
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ArithmeticOpCode.h"
+#include "StackOperations.h"
+#include "StringPrintOpCode.h"
+#include "SubtractOpCode.h"
+#include "Translator.h"
+
+/// @brief Settings of the built-in PseudoOpCodes.
+struct BuiltinOptions
+{
+    /// @brief Stacks whose pointer is kept in a register, and that register.
+    std::vector<std::pair<std::string, int>> registerStacks;
+    /// @brief Check at runtime that stacks which may grow without bound do not overflow.
+    bool                                     stackBoundsChecking = false;
+    /// @brief How stack operations are expanded, if chosen; choosing one also reports the code size of each mode.
+    std::optional<StackExpansion>            stackExpansion;
+    /// @brief In hybrid mode, stacks used on at least this many lines are outlined.
+    size_t                                   outlineThreshold    = 4;
+};
+
+/// @brief Gives the translator fresh instances of the built-in PseudoOpCodes.
+/// PseudoOpCodes carry per-file state, so every translation needs its own.
+inline void registerBuiltinPseudoOpCodes(Translator& translator, const BuiltinOptions& options = {})
+{
+    auto stackOperations = std::make_unique<StackOperations>();
+    for (auto& [stackName, stackRegister]: options.registerStacks) {
+        stackOperations->useRegisterStack(stackName, stackRegister);
+    }
+    stackOperations->setBoundsChecking(options.stackBoundsChecking);
+    if (options.stackExpansion) {
+        stackOperations->setExpansion(*options.stackExpansion, options.outlineThreshold);
+    }
+    translator.addPseudoOpCode(std::move(stackOperations));
+    translator.addPseudoOpCode(std::make_unique<StringPrintOpCode>());
+    translator.addPseudoOpCode(std::make_unique<SubtractOpCode>());
+    translator.addPseudoOpCode(std::make_unique<ArithmeticOpCode>());
+}
+
+
+#endif //LC3_LANGUAGE_EXTENDER_BUILTINPSEUDOOPCODES_H
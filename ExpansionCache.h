@@ -0,0 +1,241 @@
+#ifndef LC3_LANGUAGE_EXTENDER_EXPANSIONCACHE_H
+#define LC3_LANGUAGE_EXTENDER_EXPANSIONCACHE_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Instruction.h"
+#include "PseudoOpCode.h"
+#include "RegisterEffects.h"
+#include "SymbolTable.h"
+
+/// @brief Expansions of the tokens PseudoOpCodes declared cacheable, keyed by PseudoOpCode, token, and the registers
+/// live and reserved after it. Along with the lines, the handler of each line and the registers live after it are
+/// kept, so a repeated token costs neither handleToken() nor the analysis of what it produced.
+/// The cache can be saved to a file and loaded by a later translation. Saved expansions are stored as text, grouped by
+/// PseudoOpCode name along with its getCacheContext(); a group is dropped once its context no longer matches.
+class ExpansionCache
+{
+public:
+    struct Entry
+    {
+        std::vector<Instruction>   lines;
+        std::vector<PseudoOpCode*> handlers;
+        std::vector<RegisterSet>   liveAfter;
+    };
+
+private:
+    static constexpr std::string_view FILE_HEADER = "LC3 expansion cache 1";
+
+    struct Key
+    {
+        PseudoOpCode* pseudoOpCode;
+        Instruction   token;
+        RegisterSet   live;
+        RegisterSet   reserved;
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return key.token.hash() ^ std::hash<PseudoOpCode*>()(key.pseudoOpCode) ^
+                   (static_cast<size_t>(key.live) << 8 | key.reserved) * 0x9E3779B97F4A7C15ULL;
+        }
+    };
+
+    /// @brief Saved expansions of one PseudoOpCode, by "live reserved token" text.
+    struct StoredGroup
+    {
+        std::string                                               context;
+        std::unordered_map<std::string, std::vector<std::string>> expansions;
+        /// @brief Whether context has been compared with the PseudoOpCode's, and the result.
+        bool                                                      checked = false;
+        bool                                                      valid   = false;
+    };
+
+    SymbolTable&                                 symbols;
+    std::unordered_map<Key, Entry, KeyHash>      entries;
+    std::unordered_map<std::string, StoredGroup> stored;
+    uint64_t                                     hits       = 0;
+    uint64_t                                     misses     = 0;
+    uint64_t                                     storedHits = 0;
+
+    static std::string storedKey(const Instruction& token, RegisterSet live, RegisterSet reserved,
+                                 const SymbolTable& symbols)
+    {
+        return std::to_string(live) + " " + std::to_string(reserved) + " " + token.toString(symbols);
+    }
+
+    /// @brief Returns the saved group of the PseudoOpCode if its context is unchanged, nullptr otherwise.
+    StoredGroup* findGroup(PseudoOpCode* pseudoOpCode)
+    {
+        auto it = stored.find(pseudoOpCode->getName());
+        if (it == stored.end()) {
+            return nullptr;
+        }
+        auto& group = it->second;
+        if (!group.checked) {
+            group.checked = true;
+            group.valid   = group.context == pseudoOpCode->getCacheContext();
+            if (!group.valid) {
+                group.expansions.clear();
+            }
+        }
+        return group.valid ? &group : nullptr;
+    }
+
+    /// @brief Splits the next space separated word off the front of text.
+    static std::string_view nextWord(std::string_view& text)
+    {
+        auto word = text.substr(0, text.find(' '));
+        text.remove_prefix(std::min(text.size(), word.size() + 1));
+        return word;
+    }
+
+public:
+    explicit ExpansionCache(SymbolTable& symbols) : symbols(symbols)
+    {
+    }
+
+    /// @brief Returns the expansion of the token, or nullptr if it has not been seen in this translation.
+    const Entry* find(PseudoOpCode* pseudoOpCode, const Instruction& token, RegisterSet live, RegisterSet reserved)
+    {
+        auto it = entries.find({pseudoOpCode, token, live, reserved});
+        if (it == entries.end()) {
+            return nullptr;
+        }
+        hits++;
+        return &it->second;
+    }
+
+    /// @brief Returns the lines a loaded cache file holds for the token, parsed into this translation's symbols, and
+    /// counts a miss if there are none. The caller expands the token itself otherwise, and add()s the result either
+    /// way.
+    std::optional<std::vector<Instruction>>
+    findStored(PseudoOpCode* pseudoOpCode, const Instruction& token, RegisterSet live, RegisterSet reserved)
+    {
+        auto group = stored.empty() ? nullptr : findGroup(pseudoOpCode);
+        if (group != nullptr) {
+            auto it = group->expansions.find(storedKey(token, live, reserved, symbols));
+            if (it != group->expansions.end()) {
+                storedHits++;
+                return Instruction::parseAll(it->second, symbols);
+            }
+        }
+        misses++;
+        return std::nullopt;
+    }
+
+    void add(PseudoOpCode* pseudoOpCode, const Instruction& token, RegisterSet live, RegisterSet reserved, Entry entry)
+    {
+        entries.emplace(Key{pseudoOpCode, token, live, reserved}, std::move(entry));
+    }
+
+    /// @brief Reads expansions saved by save(). Returns false if input is not a cache file, leaving the cache empty.
+    bool load(std::istream& input)
+    {
+        std::string line;
+        if (!std::getline(input, line) || line != FILE_HEADER) {
+            return false;
+        }
+        StoredGroup* group = nullptr;
+        while (std::getline(input, line)) {
+            std::string_view rest    = line;
+            auto             keyword = nextWord(rest);
+            if (keyword == "PSEUDOOPCODE") {
+                group = &stored[std::string(rest)];
+            }
+            else if (keyword == "CONTEXT" && group != nullptr) {
+                group->context = rest;
+            }
+            else if (keyword == "ENTRY" && group != nullptr) {
+                auto   count = nextWord(rest);
+                size_t lines = 0;
+                if (std::from_chars(count.data(), count.data() + count.size(), lines).ec != std::errc()) {
+                    stored.clear();
+                    return false;
+                }
+                auto& expansion = group->expansions[std::string(rest)];
+                expansion.resize(lines);
+                for (auto& expansionLine: expansion) {
+                    std::getline(input, expansionLine);
+                }
+            }
+        }
+        return true;
+    }
+
+    /// @brief Writes every expansion of this translation, and those loaded which are still valid.
+    void save(std::ostream& output)
+    {
+        // Expansions of this translation are merged into the loaded groups, replacing those whose context changed.
+        for (auto& [key, entry]: entries) {
+            auto& group = stored[key.pseudoOpCode->getName()];
+            if (!group.checked || !group.valid) {
+                auto context = key.pseudoOpCode->getCacheContext();
+                if (group.context != context) {
+                    group.expansions.clear();
+                    group.context = context;
+                }
+                group.checked = true;
+                group.valid   = true;
+            }
+            group.expansions[storedKey(key.token, key.live, key.reserved, symbols)] =
+                    Instruction::formatAll(entry.lines, symbols);
+        }
+
+        output << FILE_HEADER << "\n";
+        for (auto& [name, group]: stored) {
+            if (group.checked && !group.valid) {
+                continue;
+            }
+            output << "PSEUDOOPCODE " << name << "\n";
+            output << "CONTEXT " << group.context << "\n";
+            for (auto& [key, lines]: group.expansions) {
+                output << "ENTRY " << lines.size() << " " << key << "\n";
+                for (auto& line: lines) {
+                    output << line << "\n";
+                }
+            }
+        }
+    }
+
+    /// @brief Adds the hits and misses of a cache used for another part of the same translation.
+    void addCounts(const ExpansionCache& other)
+    {
+        hits += other.hits;
+        misses += other.misses;
+        storedHits += other.storedHits;
+    }
+
+    /// @brief Tokens whose expansion was reused from earlier in this translation.
+    [[nodiscard]] uint64_t getHits() const
+    {
+        return hits;
+    }
+
+    /// @brief Tokens which had to be handled.
+    [[nodiscard]] uint64_t getMisses() const
+    {
+        return misses;
+    }
+
+    /// @brief Tokens whose expansion was read from a cache file.
+    [[nodiscard]] uint64_t getStoredHits() const
+    {
+        return storedHits;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_EXPANSIONCACHE_H
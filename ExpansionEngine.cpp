@@ -0,0 +1 @@
+#include "ExpansionEngine.h"
@@ -0,0 +1,341 @@
+#ifndef LC3_LANGUAGE_EXTENDER_EXPANSIONENGINE_H
+#define LC3_LANGUAGE_EXTENDER_EXPANSIONENGINE_H
+
+#include <chrono>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ExpansionCache.h"
+#include "Instruction.h"
+#include "LivenessAnalysis.h"
+#include "PseudoOpCode.h"
+#include "PseudoOpCodeList.h"
+#include "PseudoOpCodeRegistry.h"
+#include "StackDepthAnalysis.h"
+#include "TranslationStats.h"
+
+/// @brief Expands every line to its final form in a single pass.
+/// Each line is expanded depth-first: the tokens produced by a PseudoOpCode are themselves expanded in place before the
+/// next source line is looked at, and only lines no PseudoOpCode can handle reach the output. Total work is linear in
+/// the size of the output.
+/// Each PseudoOpCode is told which registers are live after the token it handles, so it can use dead registers as
+/// scratch instead of saving and restoring them. Liveness within an expansion is derived from the liveness of the token
+/// which was expanded and the declared register effects of the tokens produced.
+/// Every final line keeps the source line it was expanded from, and the name of the PseudoOpCode which produced it.
+/// Tokens a PseudoOpCode declares cacheable are only handled once per set of live registers; repeats reuse the
+/// expansion, see ExpansionCache.
+class ExpansionEngine
+{
+private:
+    /// @brief Tokens produced by one PseudoOpCode invocation which still have to be expanded.
+    struct Frame
+    {
+        Instruction                token;
+        PseudoOpCode*              handler = nullptr;
+        std::vector<Instruction>   lines;
+        /// @brief The PseudoOpCode handling each line, or nullptr if the line is final.
+        std::vector<PseudoOpCode*> handlers;
+        /// @brief The registers live after each line.
+        std::vector<RegisterSet>   liveAfter;
+        size_t                     next    = 0;
+        /// @brief The name of handler, which final lines of this frame are attributed to.
+        SymbolId                   producer = NO_SYMBOL;
+    };
+
+    /// @brief Guards against expansions which never repeat a token but also never terminate.
+    static constexpr size_t MAXIMUM_DEPTH = 256;
+
+    PseudoOpCodeRegistry& registry;
+    SymbolTable&          symbols;
+    std::ostream&         diagnostics;
+    std::vector<Frame>    frames;
+    std::string           logBuffer;
+    RegisterSet           reservedRegisters          = NO_REGISTERS;
+    /// @brief PseudoOpCodes claim registers as they are set up, so reservedRegisters is only collected once, when the
+    /// first line is expanded.
+    bool                  reservedRegistersCollected = false;
+    LogLevel              logLevel                   = LogLevel::Info;
+    TranslationStats*     stats                      = nullptr;
+    ExpansionCache        cache;
+
+    /// @brief Calls function with the PseudoOpCode as its built-in type, so the calls it makes are direct, or as a
+    /// PseudoOpCode if it is user-defined. See PseudoOpCodeList.
+    template<typename Function>
+    static decltype(auto) dispatch(PseudoOpCode* pseudoOpCode, Function&& function)
+    {
+        return BuiltinPseudoOpCodeList::visit(*pseudoOpCode, std::forward<Function>(function));
+    }
+
+    static RegisterEffects getRegisterEffects(const Instruction& line, PseudoOpCode* handler)
+    {
+        if (handler == nullptr) {
+            return RegisterEffects::of(line);
+        }
+        return dispatch(handler, [&](auto& pseudoOpCode) { return pseudoOpCode.getRegisterEffects(line); });
+    }
+
+    PseudoOpCode* findHandler(const Instruction& line)
+    {
+        for (auto pseudoOpCode: registry.getCandidates(line)) {
+            if (stats != nullptr) {
+                stats->of(pseudoOpCode).canHandleCalls++;
+            }
+            if (dispatch(pseudoOpCode, [&](auto& candidate) { return candidate.canHandle(line); })) {
+                return pseudoOpCode;
+            }
+        }
+        return nullptr;
+    }
+
+    /// @brief Collects the registers the PseudoOpCodes have claimed for the whole program.
+    [[nodiscard]] RegisterSet collectReservedRegisters() const
+    {
+        RegisterSet result = NO_REGISTERS;
+        for (auto pseudoOpCode: registry.getAll()) {
+            result |= dispatch(pseudoOpCode, [](auto& claimant) { return claimant.getClaimedRegisters(); });
+        }
+        return result;
+    }
+
+    /// @brief Rejects a source line which writes a reserved register.
+    void checkReservedRegisters(const Instruction& line, PseudoOpCode* handler) const
+    {
+        auto effects   = getRegisterEffects(line, handler);
+        auto clobbered = effects.writes & reservedRegisters;
+        if (clobbered == NO_REGISTERS) {
+            return;
+        }
+        for (int r = 0; r < 8; r++) {
+            if (!(clobbered & registerBit(r))) {
+                continue;
+            }
+            for (auto pseudoOpCode: registry.getAll()) {
+                if (pseudoOpCode->getClaimedRegisters() & registerBit(r)) {
+                    throw std::runtime_error("R" + std::to_string(r) + " is reserved by " + pseudoOpCode->getName() +
+                                             " and must not be written: " + line.toString(symbols));
+                }
+            }
+        }
+    }
+
+    /// @brief Finds the handler of every line and the registers live after it.
+    void analyze(const std::vector<Instruction>& lines, RegisterSet liveOut, std::vector<PseudoOpCode*>& handlers,
+                 std::vector<RegisterSet>& liveAfter)
+    {
+        std::vector<RegisterEffects> effects;
+        handlers.clear();
+        handlers.reserve(lines.size());
+        effects.reserve(lines.size());
+        for (auto& line: lines) {
+            auto handler = findHandler(line);
+            handlers.push_back(handler);
+            effects.push_back(getRegisterEffects(line, handler));
+        }
+        liveAfter = LivenessAnalysis::analyze(lines, effects, liveOut);
+    }
+
+    /// @brief Expands the token one step, through the cache if the handler allows it. live holds the registers live
+    /// after the token.
+    Frame handle(const Instruction& token, PseudoOpCode* handler, RegisterSet live)
+    {
+        Frame child{token, handler, {}, {}, {}};
+        child.producer = symbols.intern(dispatch(handler, [](auto& pseudoOpCode) { return pseudoOpCode.getName(); }));
+        bool cacheable = dispatch(handler, [&](auto& pseudoOpCode) { return pseudoOpCode.isCacheable(token); });
+        bool expanded  = false;
+        handler->setLiveRegisters(live | reservedRegisters);
+        handler->setReservedRegisters(reservedRegisters);
+        if (cacheable) {
+            if (auto entry = cache.find(handler, token, live, reservedRegisters)) {
+                child.lines     = entry->lines;
+                child.handlers  = entry->handlers;
+                child.liveAfter = entry->liveAfter;
+                return child;
+            }
+            if (auto lines = cache.findStored(handler, token, live, reservedRegisters)) {
+                dispatch(handler, [&](auto& pseudoOpCode) { pseudoOpCode.replayToken(token); });
+                child.lines = std::move(*lines);
+                expanded    = true;
+            }
+        }
+        if (!expanded) {
+            std::chrono::steady_clock::time_point start;
+            if (stats != nullptr) {
+                start = std::chrono::steady_clock::now();
+            }
+            child.lines = dispatch(handler, [&](auto& pseudoOpCode) { return pseudoOpCode.handleToken(token); });
+            if (stats != nullptr) {
+                stats->of(handler).time += std::chrono::steady_clock::now() - start;
+            }
+        }
+        analyze(child.lines, live, child.handlers, child.liveAfter);
+        if (cacheable) {
+            cache.add(handler, token, live, reservedRegisters, {child.lines, child.handlers, child.liveAfter});
+        }
+        return child;
+    }
+
+    /// @brief Describes the chain of tokens currently being expanded, outermost first.
+    [[nodiscard]] std::string describeChain(const Instruction& last) const
+    {
+        // The root frame only holds the source line, it is not part of the chain.
+        std::string chain;
+        for (size_t i = 1; i < frames.size(); i++) {
+            chain += frames[i].token.toString(symbols) + " (" + frames[i].handler->getName() + ") -> ";
+        }
+        return chain + last.toString(symbols);
+    }
+
+public:
+    ExpansionEngine(PseudoOpCodeRegistry& registry, std::ostream& diagnostics) : registry(registry),
+                                                                                  symbols(registry.getSymbolTable()),
+                                                                                  diagnostics(diagnostics),
+                                                                                  cache(symbols)
+    {
+    }
+
+    /// @brief The expansions of cacheable tokens, which can be saved for later translations.
+    [[nodiscard]] ExpansionCache& getCache()
+    {
+        return cache;
+    }
+
+    /// @brief Writes a line for every token handled at LogLevel::Debug.
+    void setLogLevel(LogLevel value)
+    {
+        logLevel = value;
+    }
+
+    /// @brief Counts what every PseudoOpCode does into stats, if not nullptr.
+    void setStats(TranslationStats* value)
+    {
+        stats = value;
+    }
+
+    /// @brief Merges runs of lines which their handler's mergeTokens() combines, in place. Returns the index each
+    /// remaining line had, or that of the first line merged into it.
+    std::vector<size_t> mergeTokens(std::vector<Instruction>& content)
+    {
+        std::vector<size_t> origins;
+        origins.reserve(content.size());
+        size_t kept = 0;
+        for (size_t i = 0; i < content.size(); kept++) {
+            origins.push_back(i);
+            auto line    = std::move(content[i++]);
+            auto handler = findHandler(line);
+            while (handler != nullptr && i < content.size()) {
+                auto merged = dispatch(handler, [&](auto& pseudoOpCode) {
+                    return pseudoOpCode.mergeTokens(line, content[i]);
+                });
+                if (!merged) {
+                    break;
+                }
+                line = std::move(*merged);
+                i++;
+            }
+            content[kept] = std::move(line);
+        }
+        content.resize(kept);
+        return origins;
+    }
+
+    /// @brief Finds the registers live after each line of the program, before it is expanded.
+    [[nodiscard]] std::vector<RegisterSet> analyzeLiveness(const std::vector<Instruction>& content)
+    {
+        std::vector<PseudoOpCode*> handlers;
+        std::vector<RegisterSet>   liveAfter;
+        analyze(content, ALL_REGISTERS, handlers, liveAfter);
+        return liveAfter;
+    }
+
+    /// @brief Finds how deep each stack gets over the program, before it is expanded. std::nullopt if some line's
+    /// effect on the stacks is unknown.
+    [[nodiscard]] std::optional<StackDepths> analyzeStackDepths(const std::vector<Instruction>& content)
+    {
+        std::vector<std::optional<std::vector<StackEffect>>> effects;
+        effects.reserve(content.size());
+        for (auto& line: content) {
+            auto handler = findHandler(line);
+            effects.push_back(handler ? dispatch(handler, [&](auto& pseudoOpCode) {
+                return pseudoOpCode.getStackEffects(line);
+            }) : std::vector<StackEffect>());
+        }
+        return StackDepthAnalysis::analyze(content, effects);
+    }
+
+    /// @brief Expands a single source line, appending the fully expanded result to output.
+    /// liveAfter holds the registers live after the line; by default every register is assumed to be.
+    void expand(const Instruction& line, std::vector<Instruction>& output, RegisterSet liveAfter = ALL_REGISTERS)
+    {
+        if (!reservedRegistersCollected) {
+            reservedRegisters          = collectReservedRegisters();
+            reservedRegistersCollected = true;
+        }
+        auto lineHandler = findHandler(line);
+        checkReservedRegisters(line, lineHandler);
+
+        frames.clear();
+        frames.push_back({Instruction(), nullptr, {line}, {lineHandler}, {liveAfter}, 0});
+        while (true) {
+            auto& frame = frames.back();
+            if (frame.next == frame.lines.size()) {
+                frames.pop_back();
+                if (frames.empty()) {
+                    break;
+                }
+                continue;
+            }
+
+            size_t index   = frame.next++;
+            auto&  token   = frame.lines[index];
+            auto   handler = frame.handlers[index];
+            if (handler == nullptr) {
+                output.push_back(token);
+                output.back().sourceLine = line.sourceLine;
+                output.back().producer   = frame.producer;
+                continue;
+            }
+
+            for (size_t i = 1; i < frames.size(); i++) {
+                if (frames[i].token == token) {
+                    throw std::runtime_error("Expansion cycle detected: " + describeChain(token));
+                }
+            }
+            if (frames.size() > MAXIMUM_DEPTH) {
+                throw std::runtime_error("Maximum expansion depth exceeded: " + describeChain(token));
+            }
+
+            if (logLevel >= LogLevel::Debug) {
+                logBuffer.clear();
+                token.appendTo(logBuffer, symbols);
+                diagnostics << "PseudoOpCode " << handler->getName() << " handling token " << logBuffer << "\n";
+            }
+            auto child = handle(token, handler, frame.liveAfter[index]);
+            if (stats != nullptr) {
+                auto& entry = stats->of(handler);
+                entry.hits++;
+                entry.linesProduced += child.lines.size();
+                // The root frame holds the source line, every other frame a token being expanded.
+                stats->recordDepth(frames.size());
+            }
+            frames.push_back(std::move(child));
+        }
+    }
+
+    /// @brief Expands every line of the program, in order, given the registers live after each line.
+    [[nodiscard]] std::vector<Instruction>
+    expandAll(const std::vector<Instruction>& content, const std::vector<RegisterSet>& liveAfter)
+    {
+        std::vector<Instruction> output;
+        output.reserve(content.size());
+        for (size_t i = 0; i < content.size(); i++) {
+            expand(content[i], output, liveAfter[i]);
+        }
+        return output;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_EXPANSIONENGINE_H
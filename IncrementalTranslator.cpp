@@ -0,0 +1 @@
+#include "IncrementalTranslator.h"
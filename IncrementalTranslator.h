@@ -0,0 +1,214 @@
+#ifndef LC3_LANGUAGE_EXTENDER_INCREMENTALTRANSLATOR_H
+#define LC3_LANGUAGE_EXTENDER_INCREMENTALTRANSLATOR_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Instruction.h"
+#include "RegisterEffects.h"
+#include "Translator.h"
+
+/// @brief Keeps one program translated as it is edited. The expansion of every line stays resident, along with the
+/// Translator and its PseudoOpCodes, so an edit only re-expands the lines which changed and the lines whose live
+/// registers changed with them; the program is analyzed again as a whole, which is linear and cheap next to expansion.
+/// Should the PseudoOpCodes' cache context change (e.g. a stack becomes unbounded and is now checked), everything is
+/// expanded again.
+/// As PseudoOpCodes only ever learn about strings and stacks, a string or stack the program stops using keeps its
+/// storage until the next full translation, and new ones are numbered after those already known.
+class IncrementalTranslator
+{
+public:
+    /// @brief Gives a fresh Translator its PseudoOpCodes and settings.
+    using Setup = std::function<void(Translator&)>;
+
+    struct Update
+    {
+        /// @brief Program lines (source lines which are not empty once comments are removed) expanded.
+        size_t expandedLines = 0;
+        size_t totalLines    = 0;
+        /// @brief Whether everything was translated again.
+        bool   full          = false;
+    };
+
+private:
+    Setup                                 setup;
+    std::ostream&                         diagnostics;
+    std::unique_ptr<Translator>           translator;
+    /// @brief The source, up to and including .END.
+    std::vector<std::string>              source;
+    // By program line: the first and last source line number it comes from (more than one line when lines were merged),
+    // counting from 1, the parsed line, the registers live after it, its expansion, and the expansion as text if the
+    // program is written line by line.
+    std::vector<uint32_t>                 lineNumbers;
+    std::vector<uint32_t>                 lineEnds;
+    std::vector<Instruction>              program;
+    std::vector<RegisterSet>              liveAfter;
+    std::vector<std::vector<Instruction>> expansions;
+    std::vector<std::string>              texts;
+    std::string                           context;
+    /// @brief Set when an edit failed half way, so the resident state can no longer be trusted.
+    bool                                  stale = true;
+
+    /// @brief Removes comments, parses and merges the source lines. numbers and ends receive the first and last line
+    /// number, relative to the first source line, of the source lines each program line comes from.
+    std::vector<Instruction> parse(std::vector<std::string> lines, std::vector<uint32_t>& numbers,
+                                   std::vector<uint32_t>& ends)
+    {
+        auto sourceLines = Translator::stripComments(lines);
+        auto program     = Instruction::parseAll(lines, translator->getSymbolTable());
+        auto origins     = translator->mergeTokens(program);
+        numbers.clear();
+        ends.clear();
+        for (size_t i = 0; i < origins.size(); i++) {
+            numbers.push_back(sourceLines[origins[i]]);
+            ends.push_back(sourceLines[i + 1 < origins.size() ? origins[i + 1] - 1 : sourceLines.size() - 1]);
+        }
+        return program;
+    }
+
+    void expandLine(size_t i)
+    {
+        expansions[i].clear();
+        translator->expandLine(program[i], expansions[i], liveAfter[i]);
+        if (!translator->isRewritingProgram()) {
+            texts[i].clear();
+            translator->appendLines(expansions[i], texts[i]);
+        }
+    }
+
+public:
+    IncrementalTranslator(Setup setup, std::ostream& diagnostics) : setup(std::move(setup)), diagnostics(diagnostics)
+    {
+    }
+
+    /// @brief Translates the source, as read by Translator::readSource(), from scratch.
+    Update load(std::vector<std::string> content)
+    {
+        stale      = true;
+        translator = std::make_unique<Translator>(diagnostics);
+        setup(*translator);
+        source  = std::move(content);
+        program = parse(source, lineNumbers, lineEnds);
+        expansions.assign(program.size(), {});
+        texts.assign(program.size(), {});
+        liveAfter = translator->analyze(program);
+        context   = translator->getCacheContext();
+        for (size_t i = 0; i < program.size(); i++) {
+            expandLine(i);
+        }
+        stale = false;
+        return {program.size(), program.size(), true};
+    }
+
+    /// @brief Brings the translation up to date with the new source, in which the source lines first to
+    /// first + removed - 1 (counting from 1) of the previous source were replaced by added lines. Falls back to load()
+    /// if the line counts do not add up.
+    Update change(std::vector<std::string> content, size_t first, size_t removed, size_t added)
+    {
+        if (stale || first == 0 || first - 1 + removed > source.size() ||
+            content.size() != source.size() - removed + added) {
+            return load(std::move(content));
+        }
+        stale = true;
+
+        // Program lines from the removed source lines are replaced by those of the added source lines. A program line
+        // merged from several source lines is parsed again as a whole if any of them changed.
+        auto   begin = std::lower_bound(lineEnds.begin(), lineEnds.end(), first) - lineEnds.begin();
+        auto   end   = std::lower_bound(lineNumbers.begin(), lineNumbers.end(), first + removed) - lineNumbers.begin();
+        size_t from  = first;
+        size_t to    = first + removed;
+        if (begin < end) {
+            from = std::min<size_t>(from, lineNumbers[begin]);
+            to   = std::max<size_t>(to, lineEnds[end - 1] + 1);
+        }
+        std::vector<uint32_t> numbers;
+        std::vector<uint32_t> ends;
+        auto                  lines = parse({content.begin() + static_cast<ptrdiff_t>(from - 1),
+                                             content.begin() + static_cast<ptrdiff_t>(to - 1 + added - removed)},
+                                            numbers, ends);
+        for (size_t i = 0; i < numbers.size(); i++) {
+            numbers[i] += from - 1;
+            ends[i] += from - 1;
+        }
+        for (auto i = static_cast<size_t>(end); i < lineNumbers.size(); i++) {
+            lineNumbers[i] += added - removed;
+            lineEnds[i] += added - removed;
+        }
+        auto replace = [&](auto& vector, auto replacement) {
+            vector.erase(vector.begin() + begin, vector.begin() + end);
+            vector.insert(vector.begin() + begin, replacement.begin(), replacement.end());
+        };
+        replace(lineNumbers, numbers);
+        replace(lineEnds, ends);
+        replace(program, lines);
+        replace(liveAfter, std::vector<RegisterSet>(lines.size(), ALL_REGISTERS));
+        replace(expansions, std::vector<std::vector<Instruction>>(lines.size()));
+        replace(texts, std::vector<std::string>(lines.size()));
+        source = std::move(content);
+
+        auto live = translator->analyze(program);
+        if (translator->getCacheContext() != context) {
+            return load(std::move(source));
+        }
+        Update update{0, program.size(), false};
+        for (size_t i = 0; i < program.size(); i++) {
+            bool edited = i >= static_cast<size_t>(begin) && i < static_cast<size_t>(begin) + lines.size();
+            if (edited || live[i] != liveAfter[i]) {
+                liveAfter[i] = live[i];
+                expandLine(i);
+                update.expandedLines++;
+            }
+        }
+        stale = false;
+        return update;
+    }
+
+    /// @brief Writes the translated program, with the current prologue and epilogue. Unless the program has to be
+    /// optimized or laid out as a whole, the text of every line's expansion is reused.
+    void write(std::ostream& output)
+    {
+        auto orig = std::find_if(program.begin(), program.end(), [](auto& i) { return i.opcode == Opcode::ORIG; });
+        auto end  = std::find_if(program.begin(), program.end(), [](auto& i) { return i.opcode == Opcode::END; });
+        if (translator->isRewritingProgram()) {
+            std::vector<Instruction> expanded;
+            for (auto& expansion: expansions) {
+                expanded.insert(expanded.end(), expansion.begin(), expansion.end());
+            }
+            translator->optimize(expanded);
+            translator->insertPrologueAndEpilogue(expanded);
+            translator->layOut(expanded);
+            translator->write(expanded, output);
+            return;
+        }
+
+        std::string prologue;
+        std::string epilogue;
+        translator->appendLines(translator->collectInitializationLogic(), prologue);
+        translator->appendLines(translator->collectFileEndStatements(), epilogue);
+        size_t origIndex = orig - program.begin();
+        size_t endIndex  = end - program.begin();
+        if (orig == program.end()) {
+            output << prologue;
+        }
+        for (size_t i = 0; i < program.size(); i++) {
+            if (i == endIndex) {
+                output << epilogue;
+            }
+            output << texts[i];
+            if (i == origIndex) {
+                output << prologue;
+            }
+        }
+        if (end == program.end()) {
+            output << epilogue;
+        }
+        output.flush();
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_INCREMENTALTRANSLATOR_H
@@ -0,0 +1,639 @@
+#ifndef LC3_LANGUAGE_EXTENDER_INSTRUCTION_H
+#define LC3_LANGUAGE_EXTENDER_INSTRUCTION_H
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "SymbolTable.h"
+
+enum class Opcode : uint8_t
+{
+    ADD, AND, NOT, BR, JMP, JSR, JSRR, LD, LDI, LDR, LEA, ST, STI, STR, TRAP, RET, RTI,
+    // Trap aliases
+    GETC, OUT, PUTS, IN, PUTSP, HALT,
+    // Assembler directives
+    ORIG, FILL, BLKW, STRINGZ, END,
+    /// @brief A line which only declares a label.
+    LABEL,
+    /// @brief A pseudo-instruction, named by Instruction::mnemonic.
+    PSEUDO,
+    /// @brief A line which could not be understood. Instruction::mnemonic holds its verbatim text.
+    RAW,
+};
+
+constexpr size_t OPCODE_COUNT = static_cast<size_t>(Opcode::RAW) + 1;
+
+constexpr std::array<std::string_view, OPCODE_COUNT> OPCODE_NAMES = {
+        "ADD", "AND", "NOT", "BR", "JMP", "JSR", "JSRR", "LD", "LDI", "LDR", "LEA", "ST", "STI", "STR", "TRAP", "RET",
+        "RTI", "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT", ".ORIG", ".FILL", ".BLKW", ".STRINGZ", ".END", "", "", ""};
+
+enum class ImmediateFormat : uint8_t
+{
+    None,
+    /// @brief #-1
+    Decimal,
+    /// @brief x1F
+    Hexadecimal,
+    /// @brief 31
+    Bare,
+};
+
+constexpr uint8_t CONDITION_N = 0b100;
+constexpr uint8_t CONDITION_Z = 0b010;
+constexpr uint8_t CONDITION_P = 0b001;
+
+/// @brief One line of the program.
+/// Operands always appear in the order registers, then at most one immediate, label or string literal; every LC3
+/// instruction, directive and built-in pseudo-instruction fits that shape.
+struct Instruction
+{
+    Opcode          opcode          = Opcode::RAW;
+    /// @brief BR condition flags (CONDITION_N | CONDITION_Z | CONDITION_P). 0 is a plain "BR".
+    uint8_t         conditionFlags  = 0;
+    uint8_t         registerCount   = 0;
+    ImmediateFormat immediateFormat = ImmediateFormat::None;
+    /// @brief Set when label refers to a string literal rather than a label.
+    bool            stringOperand   = false;
+    uint8_t         registers[3]    = {0, 0, 0};
+    int32_t         immediate       = 0;
+    /// @brief Label (or string literal) operand.
+    SymbolId        label           = NO_SYMBOL;
+    /// @brief Label declared at the start of the line.
+    SymbolId        definedLabel    = NO_SYMBOL;
+    /// @brief PSEUDO: the pseudo-instruction's name. RAW: the verbatim line.
+    SymbolId        mnemonic        = NO_SYMBOL;
+    /// @brief The source line this line was expanded from, counting from 1, or 0 if it was not expanded from one.
+    uint32_t        sourceLine      = 0;
+    /// @brief The name of the PseudoOpCode (or pass) which produced this line, or NO_SYMBOL if it was written by hand.
+    SymbolId        producer        = NO_SYMBOL;
+
+    /// @brief Compares what the lines say; where they came from is ignored.
+    bool operator==(const Instruction& other) const
+    {
+        return opcode == other.opcode && conditionFlags == other.conditionFlags &&
+               registerCount == other.registerCount && immediateFormat == other.immediateFormat &&
+               stringOperand == other.stringOperand && std::equal(registers, registers + 3, other.registers) &&
+               immediate == other.immediate && label == other.label && definedLabel == other.definedLabel &&
+               mnemonic == other.mnemonic;
+    }
+
+    /// @brief Hashes what the lines say, consistently with operator==.
+    [[nodiscard]] size_t hash() const
+    {
+        uint64_t value = static_cast<uint64_t>(opcode) | static_cast<uint64_t>(conditionFlags) << 8 |
+                         static_cast<uint64_t>(registerCount) << 16 | static_cast<uint64_t>(immediateFormat) << 24 |
+                         static_cast<uint64_t>(stringOperand) << 32 | static_cast<uint64_t>(registers[0]) << 40 |
+                         static_cast<uint64_t>(registers[1]) << 48 | static_cast<uint64_t>(registers[2]) << 56;
+        for (uint64_t operand: {static_cast<uint64_t>(static_cast<uint32_t>(immediate)), uint64_t(label),
+                                uint64_t(definedLabel), uint64_t(mnemonic)}) {
+            value = (value ^ operand) * 0x9E3779B97F4A7C15ULL;
+            value ^= value >> 29;
+        }
+        return static_cast<size_t>(value);
+    }
+
+    static Instruction create(Opcode opcode, std::initializer_list<int> registers = {})
+    {
+        Instruction instruction;
+        instruction.opcode = opcode;
+        for (int r: registers) {
+            instruction.registers[instruction.registerCount++] = static_cast<uint8_t>(r);
+        }
+        return instruction;
+    }
+
+    static Instruction pseudo(SymbolId mnemonic, std::initializer_list<int> registers = {})
+    {
+        auto instruction     = create(Opcode::PSEUDO, registers);
+        instruction.mnemonic = mnemonic;
+        return instruction;
+    }
+
+    static Instruction raw(SymbolId text)
+    {
+        Instruction instruction;
+        instruction.mnemonic = text;
+        return instruction;
+    }
+
+    [[nodiscard]] Instruction withImmediate(int32_t value, ImmediateFormat format = ImmediateFormat::Decimal) const
+    {
+        auto result            = *this;
+        result.immediate       = value;
+        result.immediateFormat = format;
+        return result;
+    }
+
+    [[nodiscard]] Instruction withLabel(SymbolId value) const
+    {
+        auto result  = *this;
+        result.label = value;
+        return result;
+    }
+
+    [[nodiscard]] Instruction withString(SymbolId value) const
+    {
+        auto result          = withLabel(value);
+        result.stringOperand = true;
+        return result;
+    }
+
+    [[nodiscard]] Instruction withDefinedLabel(SymbolId value) const
+    {
+        auto result         = *this;
+        result.definedLabel = value;
+        return result;
+    }
+
+    /// @brief Copies where other came from, for a line which replaces it.
+    [[nodiscard]] Instruction withOriginOf(const Instruction& other) const
+    {
+        auto result       = *this;
+        result.sourceLine = other.sourceLine;
+        result.producer   = other.producer;
+        return result;
+    }
+
+    [[nodiscard]] Instruction withProducer(SymbolId value) const
+    {
+        auto result     = *this;
+        result.producer = value;
+        return result;
+    }
+
+    /// @brief Replaces every symbol the line refers to by map(symbol), e.g. to move it to another symbol table.
+    template<typename SymbolMap>
+    [[nodiscard]] Instruction withSymbolsMapped(SymbolMap&& map) const
+    {
+        auto result = *this;
+        for (auto symbol: {&result.label, &result.definedLabel, &result.mnemonic, &result.producer}) {
+            if (*symbol != NO_SYMBOL) {
+                *symbol = map(*symbol);
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] bool hasImmediate() const
+    {
+        return immediateFormat != ImmediateFormat::None;
+    }
+
+    [[nodiscard]] bool hasLabel() const
+    {
+        return label != NO_SYMBOL && !stringOperand;
+    }
+
+    [[nodiscard]] bool hasString() const
+    {
+        return label != NO_SYMBOL && stringOperand;
+    }
+
+    /// @brief Appends the textual form of the instruction (without a line break) to out.
+    void appendTo(std::string& out, const SymbolTable& symbols) const
+    {
+        if (opcode == Opcode::RAW) {
+            out += symbols.getName(mnemonic);
+            return;
+        }
+        if (definedLabel != NO_SYMBOL) {
+            out += symbols.getName(definedLabel);
+            if (opcode == Opcode::LABEL) {
+                return;
+            }
+            out += ' ';
+        }
+
+        if (opcode == Opcode::PSEUDO) {
+            out += symbols.getName(mnemonic);
+        }
+        else {
+            out += OPCODE_NAMES[static_cast<size_t>(opcode)];
+            if (opcode == Opcode::BR) {
+                if (conditionFlags & CONDITION_N) out += 'n';
+                if (conditionFlags & CONDITION_Z) out += 'z';
+                if (conditionFlags & CONDITION_P) out += 'p';
+            }
+        }
+
+        for (int i = 0; i < registerCount; i++) {
+            out += i == 0 ? " R" : ", R";
+            out += static_cast<char>('0' + registers[i]);
+        }
+        if (hasImmediate() || label != NO_SYMBOL) {
+            out += registerCount == 0 ? " " : ", ";
+        }
+        if (hasImmediate()) {
+            appendImmediate(out);
+        }
+        else if (stringOperand) {
+            out += '"';
+            out += symbols.getName(label);
+            out += '"';
+        }
+        else if (label != NO_SYMBOL) {
+            out += symbols.getName(label);
+        }
+    }
+
+    [[nodiscard]] std::string toString(const SymbolTable& symbols) const
+    {
+        std::string result;
+        appendTo(result, symbols);
+        return result;
+    }
+
+    /// @brief Parses one line, which must already be stripped of comments and surrounding whitespace.
+    /// Lines which are not well-formed are returned as RAW so they are passed through untouched.
+    static Instruction parse(std::string_view line, SymbolTable& symbols)
+    {
+        auto result = tryParse(line, symbols);
+        return result ? *result : raw(symbols.intern(line));
+    }
+
+    template<typename Line>
+    static std::vector<Instruction> parseAll(const std::vector<Line>& lines, SymbolTable& symbols)
+    {
+        std::vector<Instruction> result;
+        result.reserve(lines.size());
+        for (auto& line: lines) {
+            result.push_back(parse(line, symbols));
+        }
+        return result;
+    }
+
+    static std::vector<std::string> formatAll(const std::vector<Instruction>& instructions,
+                                              const SymbolTable& symbols)
+    {
+        std::vector<std::string> result;
+        result.reserve(instructions.size());
+        for (auto& instruction: instructions) {
+            result.push_back(instruction.toString(symbols));
+        }
+        return result;
+    }
+
+    /// @brief Decodes the escape sequences of a .STRINGZ operand. Every escape sequence is one character.
+    static std::string decodeString(std::string_view text)
+    {
+        std::string result;
+        result.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '\\' || i + 1 == text.size()) {
+                result += text[i];
+                continue;
+            }
+            switch (text[++i]) {
+                case 'n':
+                    result += '\n';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'r':
+                    result += '\r';
+                    break;
+                case 'e':
+                    result += '\x1B';
+                    break;
+                case '0':
+                    result += '\0';
+                    break;
+                default:
+                    result += text[i];
+                    break;
+            }
+        }
+        return result;
+    }
+
+    /// @brief The inverse of decodeString(): escapes the characters a .STRINGZ operand cannot hold verbatim.
+    static std::string encodeString(std::string_view text)
+    {
+        std::string result;
+        result.reserve(text.size());
+        for (char c: text) {
+            switch (c) {
+                case '\n':
+                    result += "\\n";
+                    break;
+                case '\t':
+                    result += "\\t";
+                    break;
+                case '\r':
+                    result += "\\r";
+                    break;
+                case '\x1B':
+                    result += "\\e";
+                    break;
+                case '\0':
+                    result += "\\0";
+                    break;
+                case '"':
+                case '\\':
+                    result += '\\';
+                    result += c;
+                    break;
+                default:
+                    result += c;
+                    break;
+            }
+        }
+        return result;
+    }
+
+    /// @brief Looks up an LC3 opcode, trap alias or directive by name, ignoring case.
+    static std::optional<Opcode> findOpcode(std::string_view word, uint8_t& conditionFlags)
+    {
+        char upper[10];
+        if (word.empty() || word.size() > sizeof(upper)) {
+            return std::nullopt;
+        }
+        for (size_t i = 0; i < word.size(); i++) {
+            upper[i] = static_cast<char>(toupper(static_cast<unsigned char>(word[i])));
+        }
+        std::string_view name(upper, word.size());
+
+        conditionFlags = 0;
+        if (name.starts_with("BR") && name.size() <= 5) {
+            // BR[n][z][p], flags in that order.
+            size_t i = 2;
+            for (auto [letter, flag]: {std::pair{'N', CONDITION_N}, {'Z', CONDITION_Z}, {'P', CONDITION_P}}) {
+                if (i < name.size() && name[i] == letter) {
+                    conditionFlags |= flag;
+                    i++;
+                }
+            }
+            if (i == name.size()) {
+                return Opcode::BR;
+            }
+            conditionFlags = 0;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(Opcode::LABEL); i++) {
+            if (i != static_cast<size_t>(Opcode::BR) && OPCODE_NAMES[i] == name) {
+                return static_cast<Opcode>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    void appendImmediate(std::string& out) const
+    {
+        char buffer[16];
+        switch (immediateFormat) {
+            case ImmediateFormat::Decimal:
+                out += '#';
+                [[fallthrough]];
+            case ImmediateFormat::Bare: {
+                auto [end, _] = std::to_chars(buffer, buffer + sizeof(buffer), immediate);
+                out.append(buffer, end);
+                break;
+            }
+            case ImmediateFormat::Hexadecimal: {
+                out += 'x';
+                uint32_t magnitude = immediate < 0 ? -static_cast<uint32_t>(immediate) : immediate;
+                if (immediate < 0) {
+                    out += '-';
+                }
+                auto [end, _] = std::to_chars(buffer, buffer + sizeof(buffer), magnitude, 16);
+                for (char* c = buffer; c != end; c++) {
+                    out += static_cast<char>(toupper(static_cast<unsigned char>(*c)));
+                }
+                break;
+            }
+            case ImmediateFormat::None:
+                break;
+        }
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    static std::string_view trimLeft(std::string_view text)
+    {
+        while (!text.empty() && isSpace(text.front())) {
+            text.remove_prefix(1);
+        }
+        return text;
+    }
+
+    /// @brief Splits the leading word off text, leaving the remainder in text.
+    static std::string_view takeWord(std::string_view& text)
+    {
+        text = trimLeft(text);
+        size_t end = 0;
+        while (end < text.size() && !isSpace(text[end]) && text[end] != ',') {
+            end++;
+        }
+        auto word = text.substr(0, end);
+        text.remove_prefix(end);
+        return word;
+    }
+
+    static bool isIdentifier(std::string_view word)
+    {
+        if (word.empty() || isdigit(static_cast<unsigned char>(word[0]))) {
+            return false;
+        }
+        for (char c: word) {
+            if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '.' && c != '$') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::optional<uint8_t> parseRegister(std::string_view word)
+    {
+        if (word.size() == 2 && (word[0] == 'R' || word[0] == 'r') && word[1] >= '0' && word[1] <= '7') {
+            return static_cast<uint8_t>(word[1] - '0');
+        }
+        return std::nullopt;
+    }
+
+    static bool parseImmediate(std::string_view word, int32_t& value, ImmediateFormat& format)
+    {
+        int base = 10;
+        if (word.starts_with('#')) {
+            format = ImmediateFormat::Decimal;
+            word.remove_prefix(1);
+        }
+        else if (word.starts_with('x') || word.starts_with('X')) {
+            format = ImmediateFormat::Hexadecimal;
+            base   = 16;
+            word.remove_prefix(1);
+        }
+        else {
+            format = ImmediateFormat::Bare;
+        }
+        bool negative = word.starts_with('-');
+        if (negative) {
+            word.remove_prefix(1);
+        }
+        if (word.empty()) {
+            return false;
+        }
+        int64_t magnitude = 0;
+        auto [end, error] = std::from_chars(word.data(), word.data() + word.size(), magnitude, base);
+        if (error != std::errc() || end != word.data() + word.size() || magnitude > 0xFFFF) {
+            return false;
+        }
+        value = static_cast<int32_t>(negative ? -magnitude : magnitude);
+        return true;
+    }
+
+    /// @brief Checks that the operands fit the opcode, so malformed lines are left untouched.
+    [[nodiscard]] bool isWellFormed() const
+    {
+        bool target = hasImmediate() || label != NO_SYMBOL;
+        switch (opcode) {
+            case Opcode::ADD:
+            case Opcode::AND:
+                return (registerCount == 3 && !target) || (registerCount == 2 && hasImmediate());
+            case Opcode::NOT:
+                return registerCount == 2 && !target;
+            case Opcode::BR:
+            case Opcode::JSR:
+                return registerCount == 0 && target && !stringOperand;
+            case Opcode::JMP:
+            case Opcode::JSRR:
+                return registerCount == 1 && !target;
+            case Opcode::LD:
+            case Opcode::LDI:
+            case Opcode::LEA:
+            case Opcode::ST:
+            case Opcode::STI:
+                return registerCount == 1 && target && !stringOperand;
+            case Opcode::LDR:
+            case Opcode::STR:
+                return registerCount == 2 && hasImmediate();
+            case Opcode::TRAP:
+            case Opcode::ORIG:
+            case Opcode::BLKW:
+                return registerCount == 0 && hasImmediate();
+            case Opcode::FILL:
+                return registerCount == 0 && target && !stringOperand;
+            case Opcode::STRINGZ:
+                return registerCount == 0 && stringOperand;
+            case Opcode::RET:
+            case Opcode::RTI:
+            case Opcode::GETC:
+            case Opcode::OUT:
+            case Opcode::PUTS:
+            case Opcode::IN:
+            case Opcode::PUTSP:
+            case Opcode::HALT:
+            case Opcode::END:
+                return registerCount == 0 && !target;
+            default:
+                return true;
+        }
+    }
+
+    static std::optional<Instruction> tryParse(std::string_view line, SymbolTable& symbols)
+    {
+        Instruction result;
+        auto        rest  = line;
+        auto        first = takeWord(rest);
+        if (first.empty()) {
+            return std::nullopt;
+        }
+
+        if (auto opcode = findOpcode(first, result.conditionFlags)) {
+            result.opcode = *opcode;
+        }
+        else {
+            if (!isIdentifier(first)) {
+                return std::nullopt;
+            }
+            if (trimLeft(rest).empty()) {
+                result.opcode       = Opcode::LABEL;
+                result.definedLabel = symbols.intern(first);
+                return result;
+            }
+            auto afterSecond = rest;
+            auto second      = takeWord(afterSecond);
+            if (auto opcode = findOpcode(second, result.conditionFlags)) {
+                result.opcode       = *opcode;
+                result.definedLabel = symbols.intern(first);
+                rest                = afterSecond;
+            }
+            else {
+                result.opcode   = Opcode::PSEUDO;
+                result.mnemonic = symbols.intern(first);
+            }
+        }
+
+        bool expectSeparator = false;
+        bool finished        = false;
+        while (true) {
+            rest = trimLeft(rest);
+            if (rest.empty()) {
+                break;
+            }
+            if (expectSeparator && rest.front() == ',') {
+                rest = trimLeft(rest.substr(1));
+            }
+            if (finished || rest.empty()) {
+                return std::nullopt;
+            }
+            expectSeparator = true;
+
+            if (rest.front() == '"') {
+                // String literal; escapes are kept verbatim.
+                size_t end = 1;
+                while (end < rest.size() && rest[end] != '"') {
+                    end += rest[end] == '\\' ? 2 : 1;
+                }
+                if (end >= rest.size()) {
+                    return std::nullopt;
+                }
+                result.label         = symbols.intern(rest.substr(1, end - 1));
+                result.stringOperand = true;
+                rest.remove_prefix(end + 1);
+                finished = true;
+                continue;
+            }
+
+            auto word = takeWord(rest);
+            if (word.empty()) {
+                return std::nullopt;
+            }
+            if (auto reg = parseRegister(word)) {
+                if (result.registerCount == 3) {
+                    return std::nullopt;
+                }
+                result.registers[result.registerCount++] = *reg;
+            }
+            else if (parseImmediate(word, result.immediate, result.immediateFormat)) {
+                finished = true;
+            }
+            else if (isIdentifier(word)) {
+                result.immediateFormat = ImmediateFormat::None;
+                result.label           = symbols.intern(word);
+                finished = true;
+            }
+            else {
+                return std::nullopt;
+            }
+        }
+
+        if (!result.isWellFormed()) {
+            return std::nullopt;
+        }
+        return result;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_INSTRUCTION_H
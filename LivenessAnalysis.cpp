@@ -0,0 +1 @@
+#include "LivenessAnalysis.h"
@@ -0,0 +1,137 @@
+#ifndef LC3_LANGUAGE_EXTENDER_LIVENESSANALYSIS_H
+#define LC3_LANGUAGE_EXTENDER_LIVENESSANALYSIS_H
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "Instruction.h"
+#include "RegisterEffects.h"
+
+/// @brief Finds the registers which are live after each line of a piece of code: those which may still be read before
+/// they are overwritten. Branches to labels defined within the code are followed, so loops are handled; anything
+/// else which leaves the code is assumed to use every register.
+class LivenessAnalysis
+{
+public:
+    /// @brief How many instructions ahead isDead() searches for a use before it assumes a value is live.
+    static constexpr size_t LOOKAHEAD = 32;
+
+    /// @brief Whether the given registers, and the condition codes if asked for, are overwritten before they are read
+    /// when execution continues at program[from]. Only straight-line code is looked across, along with unconditional
+    /// branches and JSRs to the labels given: anything else which may transfer control counts as a use.
+    [[nodiscard]] static bool isDead(const std::vector<Instruction>& program, size_t from, RegisterSet registers,
+                                     bool conditionCodes,
+                                     const std::unordered_map<SymbolId, size_t>* labels = nullptr)
+    {
+        size_t i = from;
+        for (size_t steps = 0; steps < LOOKAHEAD && i < program.size(); steps++) {
+            auto& line = program[i];
+            bool  jump = line.opcode == Opcode::JSR ||
+                         (line.opcode == Opcode::BR && RegisterEffects::isUnconditional(line));
+            if (jump && labels != nullptr && line.label != NO_SYMBOL) {
+                if (auto target = labels->find(line.label); target != labels->end()) {
+                    if (line.opcode == Opcode::JSR) {
+                        registers &= ~registerBit(7);
+                    }
+                    i = target->second;
+                    continue;
+                }
+            }
+            auto effects = RegisterEffects::of(line);
+            if ((effects.reads & registers) || (conditionCodes && effects.readsConditionCodes)) {
+                return false;
+            }
+            registers &= ~effects.writes;
+            conditionCodes &= !effects.setsConditionCodes;
+            if ((registers == NO_REGISTERS && !conditionCodes) || effects.flow == ControlFlow::Halt) {
+                return true;
+            }
+            if (effects.flow != ControlFlow::Next) {
+                return false;
+            }
+            i++;
+        }
+        return false;
+    }
+
+    /// @brief The register whose sign the condition codes hold when execution reaches program[at], which can then be
+    /// tested again to restore them. Only straight-line code is looked back across, and nothing may branch into it.
+    /// Returns -1 if nothing has set them since the program began, and std::nullopt if it cannot be told.
+    [[nodiscard]] static std::optional<int> conditionCodeSource(const std::vector<Instruction>& program, size_t at)
+    {
+        RegisterSet written = NO_REGISTERS;
+        for (size_t i = at; i-- > 0 && i + LOOKAHEAD > at;) {
+            if (program[i + 1].definedLabel != NO_SYMBOL) {
+                return std::nullopt;
+            }
+            auto effects = RegisterEffects::of(program[i]);
+            if (effects.flow != ControlFlow::Next) {
+                return std::nullopt;
+            }
+            if (program[i].opcode == Opcode::ORIG) {
+                return -1;
+            }
+            if (effects.setsConditionCodes) {
+                int r = program[i].registers[0];
+                return written & registerBit(r) ? std::nullopt : std::optional<int>(r);
+            }
+            written |= effects.writes;
+        }
+        return at < LOOKAHEAD ? std::optional<int>(-1) : std::nullopt;
+    }
+
+    /// @brief effects holds the effects of each line; liveOut is what is live when execution runs off the end.
+    [[nodiscard]] static std::vector<RegisterSet>
+    analyze(const std::vector<Instruction>& lines, const std::vector<RegisterEffects>& effects, RegisterSet liveOut)
+    {
+        size_t                               count = lines.size();
+        std::unordered_map<SymbolId, size_t> labels;
+        for (size_t i = 0; i < count; i++) {
+            if (lines[i].definedLabel != NO_SYMBOL) {
+                labels.emplace(lines[i].definedLabel, i);
+            }
+        }
+
+        // liveIn[count] stands for whatever follows the code. Sets only ever grow, so iterating until nothing changes
+        // terminates; code without backward branches settles in a single sweep.
+        std::vector<RegisterSet> liveIn(count + 1, NO_REGISTERS);
+        std::vector<RegisterSet> liveAfter(count, NO_REGISTERS);
+        liveIn[count] = liveOut;
+        bool changed  = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = count; i-- > 0;) {
+                RegisterSet after = NO_REGISTERS;
+                switch (effects[i].flow) {
+                    case ControlFlow::Next:
+                        after = liveIn[i + 1];
+                        break;
+                    case ControlFlow::Branch: {
+                        auto target = labels.find(lines[i].label);
+                        after = target == labels.end() ? ALL_REGISTERS : liveIn[target->second];
+                        if (!RegisterEffects::isUnconditional(lines[i])) {
+                            after |= liveIn[i + 1];
+                        }
+                        break;
+                    }
+                    case ControlFlow::Unknown:
+                        after = ALL_REGISTERS;
+                        break;
+                    case ControlFlow::Halt:
+                        break;
+                }
+                liveAfter[i] = after;
+                RegisterSet in = effects[i].reads | (after & ~effects[i].writes);
+                if (in != liveIn[i]) {
+                    liveIn[i] = in;
+                    changed   = true;
+                }
+            }
+        }
+        return liveAfter;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_LIVENESSANALYSIS_H
@@ -0,0 +1 @@
+#include "PeepholeOptimizer.h"
@@ -0,0 +1,253 @@
+#ifndef LC3_LANGUAGE_EXTENDER_PEEPHOLEOPTIMIZER_H
+#define LC3_LANGUAGE_EXTENDER_PEEPHOLEOPTIMIZER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "Instruction.h"
+#include "LivenessAnalysis.h"
+#include "RegisterEffects.h"
+#include "SymbolTable.h"
+
+/// @brief Removes redundant instructions from expanded LC3 code.
+/// Only straight-line code is looked across: anything which may transfer control ends the search, so the program
+/// behaves the same on every path through it. Labelled instructions are never removed, since they may be jumped to.
+class PeepholeOptimizer
+{
+private:
+    /// @brief A push or a pop as StackOperations expands it.
+    struct StackSequence
+    {
+        bool     push;
+        int      target;
+        /// @brief The register clobbered by a push which did not save its scratch register, or -1.
+        int      scratch;
+        SymbolId stackPointer;
+        size_t   length;
+    };
+
+    const SymbolTable& symbols;
+
+    static bool isUnlabelled(const Instruction* begin, const Instruction* end)
+    {
+        return std::all_of(begin, end, [](auto& i) { return i.definedLabel == NO_SYMBOL; });
+    }
+
+    static bool isMemoryAccess(const Instruction& instruction, Opcode opcode, int r, SymbolId label)
+    {
+        return instruction.opcode == opcode && instruction.registerCount == 1 && instruction.registers[0] == r &&
+               instruction.label == label;
+    }
+
+    static bool isIncrement(const Instruction& instruction, int r, int amount)
+    {
+        return instruction.opcode == Opcode::ADD && instruction.registerCount == 2 && instruction.registers[0] == r &&
+               instruction.registers[1] == r && instruction.hasImmediate() && instruction.immediate == amount;
+    }
+
+    /// @brief ADD r, r, #imm
+    static bool isAddImmediate(const Instruction& instruction)
+    {
+        return instruction.opcode == Opcode::ADD && instruction.registerCount == 2 &&
+               instruction.registers[0] == instruction.registers[1] && instruction.hasImmediate();
+    }
+
+    /// @brief AND r, r, #0
+    static bool isClear(const Instruction& instruction)
+    {
+        return instruction.opcode == Opcode::AND && instruction.registerCount == 2 &&
+               instruction.registers[0] == instruction.registers[1] && instruction.hasImmediate() &&
+               instruction.immediate == 0;
+    }
+
+    /// @brief Recognizes the expansion of PUSH_${STACK} or POP_${STACK} ending just before program[end].
+    [[nodiscard]] std::optional<StackSequence> matchStackSequence(const std::vector<Instruction>& program,
+                                                                  size_t end) const
+    {
+        // Pop:  LD r, P / ADD r, r, #-1 / ST r, P / LDR r, r, #0
+        // Push: STI r, P / LD t, P / ADD t, t, #1 / ST t, P
+        // or, saving the scratch register: STI r, P / ST t, S / LD t, P / ADD t, t, #1 / ST t, P / LD t, S
+        if (end < 4) {
+            return std::nullopt;
+        }
+        auto& last = program[end - 1];
+        if (last.opcode == Opcode::LDR) {
+            auto* pop = &program[end - 4];
+            int   r   = pop[0].registers[0];
+            if (isUnlabelled(pop, pop + 4) && pop[0].opcode == Opcode::LD && pop[0].registerCount == 1 &&
+                pop[0].label != NO_SYMBOL && symbols.isGenerated(pop[0].label) && isIncrement(pop[1], r, -1) &&
+                isMemoryAccess(pop[2], Opcode::ST, r, pop[0].label) && last.registerCount == 2 &&
+                last.registers[0] == r && last.registers[1] == r && last.immediate == 0) {
+                return StackSequence{false, r, -1, pop[0].label, 4};
+            }
+            return std::nullopt;
+        }
+
+        bool   saved  = last.opcode == Opcode::LD && end >= 6 && program[end - 6].opcode == Opcode::STI;
+        size_t length = saved ? 6 : 4;
+        auto*  push   = &program[end - length];
+        auto*  body   = saved ? push + 2 : push + 1;
+        int    r      = push[0].registers[0];
+        int    t      = body[0].registers[0];
+        auto   sp     = push[0].label;
+        if (!isUnlabelled(push, push + length) || push[0].opcode != Opcode::STI || sp == NO_SYMBOL ||
+            !symbols.isGenerated(sp) || t == r || !isMemoryAccess(body[0], Opcode::LD, t, sp) ||
+            !isIncrement(body[1], t, 1) || !isMemoryAccess(body[2], Opcode::ST, t, sp)) {
+            return std::nullopt;
+        }
+        if (saved) {
+            auto saveLocation = push[1].label;
+            if (!isMemoryAccess(push[1], Opcode::ST, t, saveLocation) || saveLocation == NO_SYMBOL ||
+                saveLocation == sp || !symbols.isGenerated(saveLocation) ||
+                !isMemoryAccess(last, Opcode::LD, t, saveLocation)) {
+                return std::nullopt;
+            }
+        }
+        return StackSequence{true, r, saved ? -1 : t, sp, length};
+    }
+
+    /// @brief Removes a pop immediately followed by a push of the same register onto the same stack.
+    /// The pair leaves the stack as it was and only loads the top of the stack into the register, so it can go when the
+    /// register (and the push's scratch register) and the condition codes are dead afterwards.
+    size_t removeCancellingStackOperations(std::vector<Instruction>& program) const
+    {
+        std::vector<Instruction> output;
+        output.reserve(program.size());
+        size_t removed = 0;
+        for (size_t i = 0; i < program.size(); i++) {
+            output.push_back(program[i]);
+            auto push = matchStackSequence(output, output.size());
+            if (!push || !push->push) {
+                continue;
+            }
+            auto pop = matchStackSequence(output, output.size() - push->length);
+            if (!pop || pop->push || pop->target != push->target || pop->stackPointer != push->stackPointer) {
+                continue;
+            }
+            RegisterSet clobbered = registerBit(push->target) | (push->scratch < 0 ? 0 : registerBit(push->scratch));
+            if (LivenessAnalysis::isDead(program, i + 1, clobbered, true)) {
+                output.resize(output.size() - push->length - pop->length);
+                removed += push->length + pop->length;
+            }
+        }
+        program = std::move(output);
+        return removed;
+    }
+
+    /// @brief Simplifies the end of output, which is followed by program[next]. Returns false if nothing changed.
+    static bool simplifyTail(std::vector<Instruction>& output, const std::vector<Instruction>& program, size_t next,
+                             size_t& removed)
+    {
+        auto& last = output.back();
+        if (output.size() >= 2 && last.definedLabel == NO_SYMBOL) {
+            auto& previous = output[output.size() - 2];
+            // LD r, L / ST r, L: the store writes back the value just loaded.
+            if (isMemoryAccess(previous, Opcode::LD, last.registers[0], last.label) &&
+                isMemoryAccess(last, Opcode::ST, previous.registers[0], previous.label)) {
+                output.pop_back();
+                removed++;
+                return true;
+            }
+            // ST r, L / LD r, L: the load reads back the value just stored, only setting the condition codes.
+            if (isMemoryAccess(previous, Opcode::ST, last.registers[0], last.label) &&
+                isMemoryAccess(last, Opcode::LD, previous.registers[0], previous.label) &&
+                LivenessAnalysis::isDead(program, next, NO_REGISTERS, true)) {
+                output.pop_back();
+                removed++;
+                return true;
+            }
+            // AND r, r, #0 / ADD r, r, s: copies s, which ADD r, s, #0 does in one instruction.
+            if (isClear(previous) && last.opcode == Opcode::ADD && last.registerCount == 3 &&
+                last.registers[0] == previous.registers[0]) {
+                int r = last.registers[0];
+                int s = last.registers[1] == r ? last.registers[2] : last.registers[1];
+                if ((last.registers[1] == r || last.registers[2] == r) && s != r) {
+                    previous = Instruction::create(Opcode::ADD, {r, s}).withImmediate(0)
+                                                                        .withDefinedLabel(previous.definedLabel)
+                                                                        .withOriginOf(previous);
+                    output.pop_back();
+                    removed++;
+                    return true;
+                }
+            }
+            // ADD r, r, #a / ADD r, r, #b: a single ADD does both, if the sum still fits in five bits.
+            if (isAddImmediate(previous) && isAddImmediate(last) && previous.registers[0] == last.registers[0] &&
+                previous.immediate + last.immediate >= -16 && previous.immediate + last.immediate <= 15) {
+                previous = previous.withImmediate(previous.immediate + last.immediate);
+                output.pop_back();
+                removed++;
+                return true;
+            }
+            // LDR r, b, #o / STR r, b, #o: the store writes back the value just loaded.
+            if (previous.opcode == Opcode::LDR && last.opcode == Opcode::STR &&
+                previous.registers[0] == last.registers[0] && previous.registers[1] == last.registers[1] &&
+                previous.registers[0] != previous.registers[1] && previous.immediate == last.immediate) {
+                output.pop_back();
+                removed++;
+                return true;
+            }
+        }
+        // ADD r, r, #0 only sets the condition codes.
+        if (isAddImmediate(last) && last.immediate == 0 && last.definedLabel == NO_SYMBOL &&
+            LivenessAnalysis::isDead(program, next, NO_REGISTERS, true)) {
+            output.pop_back();
+            removed++;
+            return true;
+        }
+        // A register write nothing reads, such as AND r, r, #0 right before r is loaded.
+        switch (last.opcode) {
+            case Opcode::ADD:
+            case Opcode::AND:
+            case Opcode::NOT:
+            case Opcode::LD:
+            case Opcode::LEA:
+                if (last.definedLabel == NO_SYMBOL &&
+                    LivenessAnalysis::isDead(program, next, registerBit(last.registers[0]), true)) {
+                    output.pop_back();
+                    removed++;
+                    return true;
+                }
+                break;
+            default:
+                break;
+        }
+        return false;
+    }
+
+    static size_t simplify(std::vector<Instruction>& program)
+    {
+        std::vector<Instruction> output;
+        output.reserve(program.size());
+        size_t removed = 0;
+        for (size_t i = 0; i < program.size(); i++) {
+            output.push_back(program[i]);
+            while (!output.empty() && simplifyTail(output, program, i + 1, removed)) {
+            }
+        }
+        program = std::move(output);
+        return removed;
+    }
+
+public:
+    explicit PeepholeOptimizer(const SymbolTable& symbols) : symbols(symbols)
+    {
+    }
+
+    /// @brief Optimizes the program in place. Returns the number of instructions removed.
+    size_t optimize(std::vector<Instruction>& program) const
+    {
+        // Stack operations are matched first, the local simplifications would otherwise break up their patterns.
+        size_t removed = 0;
+        size_t pass;
+        do {
+            pass = removeCancellingStackOperations(program);
+            pass += simplify(program);
+            removed += pass;
+        } while (pass > 0);
+        return removed;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_PEEPHOLEOPTIMIZER_H
@@ -5,15 +5,139 @@
 #ifndef LC3_LANGUAGE_EXTENDER_PSEUDOOPCODE_H
 #define LC3_LANGUAGE_EXTENDER_PSEUDOOPCODE_H
 
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <typeinfo>
 #include <vector>
+#include "Instruction.h"
+#include "RegisterEffects.h"
+#include "StackDepthAnalysis.h"
+#include "SymbolTable.h"
+
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#endif
 
 class PseudoOpCode
 {
 public:
+    /// @brief getListIndex() of a PseudoOpCode whose type is not in BuiltinPseudoOpCodeList.
+    static constexpr uint8_t UNLISTED = 0xFF;
+
+private:
+    SymbolTable*                 symbolTable = nullptr;
+    std::unique_ptr<SymbolTable> ownSymbolTable;
+    RegisterSet                  liveRegisters     = ALL_REGISTERS;
+    RegisterSet                  reservedRegisters = NO_REGISTERS;
+    uint8_t                      listIndex         = UNLISTED;
+
+protected:
+    /// @brief The symbol table the instructions handed to and produced by this PseudoOpCode refer to.
+    SymbolTable& getSymbolTable()
+    {
+        if (symbolTable == nullptr) {
+            ownSymbolTable = std::make_unique<SymbolTable>();
+            symbolTable    = ownSymbolTable.get();
+        }
+        return *symbolTable;
+    }
+
+    /// @brief Registers which may be read after the token being handled. Any other register may be clobbered.
+    [[nodiscard]] RegisterSet getLiveRegisters() const
+    {
+        return liveRegisters;
+    }
+
+    /// @brief Registers claimed by some PseudoOpCode for the whole program, which must never be used as scratch.
+    [[nodiscard]] RegisterSet getReservedRegisters() const
+    {
+        return reservedRegisters;
+    }
+
+    /// @brief Finds a register among R0 to R6 which is neither live, reserved nor excluded, trying first, first + 1,
+    /// ... in turn. R7 is never picked, as it holds the return address of subroutines and traps.
+    [[nodiscard]] std::optional<int> findDeadRegister(RegisterSet excluded, int first) const
+    {
+        for (int i = 0; i < 7; i++) {
+            int r = (first + i) % 7;
+            if (!((liveRegisters | reservedRegisters | excluded) & registerBit(r))) {
+                return r;
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// @brief Copies everything but a symbol table of its own, for clone(). The copy shares this one's table until it
+    /// is registered with another.
+    PseudoOpCode(const PseudoOpCode& other) : symbolTable(other.symbolTable), liveRegisters(other.liveRegisters),
+                                              reservedRegisters(other.reservedRegisters)
+    {
+    }
+
+public:
+    PseudoOpCode() = default;
+
+    PseudoOpCode& operator=(const PseudoOpCode&) = delete;
+
+    virtual ~PseudoOpCode() = default;
+
+    /// @brief Shares the translation's symbol table with this PseudoOpCode. Called when it is registered.
+    void setSymbolTable(SymbolTable& table)
+    {
+        symbolTable = &table;
+        ownSymbolTable.reset();
+    }
+
+    /// @brief Tells this PseudoOpCode which registers are live after the token it is about to handle. Called by the
+    /// expansion engine; when it is never called, every register is assumed to be live.
+    void setLiveRegisters(RegisterSet registers)
+    {
+        liveRegisters = registers;
+    }
+
+    /// @brief Tells this PseudoOpCode which registers are claimed by PseudoOpCodes for the whole program.
+    void setReservedRegisters(RegisterSet registers)
+    {
+        reservedRegisters = registers;
+    }
+
+    /// @brief Tells this PseudoOpCode where its type is in BuiltinPseudoOpCodeList. Called when it is registered.
+    void setListIndex(uint8_t index)
+    {
+        listIndex = index;
+    }
+
+    /// @brief The position of this PseudoOpCode's type in BuiltinPseudoOpCodeList, or UNLISTED.
+    [[nodiscard]] uint8_t getListIndex() const
+    {
+        return listIndex;
+    }
+
+    /// @brief The name diagnostics, statistics and the expansion cache know this PseudoOpCode by. Defaults to the
+    /// (demangled, where the ABI allows) name of its type.
     [[nodiscard]] virtual std::string getName()
     {
-        return typeid(*this).name();
+        const char* name = typeid(*this).name();
+#if __has_include(<cxxabi.h>)
+        int                                         status = 0;
+        std::unique_ptr<char, decltype(&std::free)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status),
+                                                              &std::free);
+        if (status == 0 && demangled != nullptr) {
+            return demangled.get();
+        }
+#endif
+        return name;
+    }
+
+    /// @brief Lists the leading words of the lines this PseudoOpCode can handle.
+    /// A mnemonic ending in '_' is a prefix (e.g. "PUSH_" matches "PUSH_TEMP"), anything else must match the whole
+    /// leading word. PseudoOpCodes which return no mnemonics are offered every line.
+    [[nodiscard]] virtual std::vector<std::string> getMnemonics()
+    {
+        return {};
     }
 
     /// @brief Produces initialization logic to be inserted at the beginning of the program.
@@ -29,6 +153,109 @@ public:
 
     /// @brief Handles the given token. Source token line is replaced for the result tokens.
     [[nodiscard]] virtual std::vector<std::string> handleToken(const std::string& token) = 0;
+
+    // Instruction based interface. The defaults round-trip through the text based interface above, so a PseudoOpCode
+    // only has to implement one of the two; the built-in PseudoOpCodes implement these natively.
+
+    [[nodiscard]] virtual std::vector<Instruction> getInitializationInstructions()
+    {
+        return Instruction::parseAll(getInitializationLogic(), getSymbolTable());
+    }
+
+    [[nodiscard]] virtual std::vector<Instruction> getFileEndInstructions()
+    {
+        return Instruction::parseAll(getFileEndStatements(), getSymbolTable());
+    }
+
+    [[nodiscard]] virtual bool canHandle(const Instruction& token)
+    {
+        return canHandle(token.toString(getSymbolTable()));
+    }
+
+    [[nodiscard]] virtual std::vector<Instruction> handleToken(const Instruction& token)
+    {
+        return Instruction::parseAll(handleToken(token.toString(getSymbolTable())), getSymbolTable());
+    }
+
+    /// @brief Registers this PseudoOpCode needs for itself throughout the program, e.g. to hold a stack pointer. No
+    /// other PseudoOpCode uses them as scratch, and source lines which write them are rejected.
+    [[nodiscard]] virtual RegisterSet getClaimedRegisters()
+    {
+        return NO_REGISTERS;
+    }
+
+    /// @brief What the given token does to the registers once expanded, however it ends up being expanded. Used to work
+    /// out which registers are live around it. The default assumes nothing: every register may be read.
+    [[nodiscard]] virtual RegisterEffects getRegisterEffects([[maybe_unused]] const Instruction& token)
+    {
+        return RegisterEffects::unknown();
+    }
+
+    /// @brief What the given token does to the stacks once expanded, including any stack its expansion uses internally.
+    /// Used to work out how much storage every stack needs. The default, std::nullopt, means unknown, and leaves every
+    /// stack at its default size.
+    [[nodiscard]] virtual std::optional<std::vector<StackEffect>>
+    getStackEffects([[maybe_unused]] const Instruction& token)
+    {
+        return std::nullopt;
+    }
+
+    /// @brief Merges a token this PseudoOpCode handles with the line immediately following it into one token doing the
+    /// work of both, e.g. two PRINTs into one. Called on the program before it is analyzed, so a run of tokens is
+    /// expanded as one. The default, std::nullopt, leaves both lines alone.
+    [[nodiscard]] virtual std::optional<Instruction> mergeTokens([[maybe_unused]] const Instruction& first,
+                                                                   [[maybe_unused]] const Instruction& second)
+    {
+        return std::nullopt;
+    }
+
+    /// @brief Whether handleToken() returns the same lines for every occurrence of this token, given the same live and
+    /// reserved registers and the same getCacheContext(). If so, the expansion engine handles each distinct token once
+    /// and reuses the result. The default, false, always calls handleToken().
+    [[nodiscard]] virtual bool isCacheable([[maybe_unused]] const Instruction& token)
+    {
+        return false;
+    }
+
+    /// @brief Describes whatever else the expansion of cacheable tokens depends on, e.g. options and the analyses the
+    /// PseudoOpCode was given. Expansions read from a cache file are only used while the context is unchanged.
+    [[nodiscard]] virtual std::string getCacheContext()
+    {
+        return "";
+    }
+
+    /// @brief Called instead of handleToken() when the expansion of a cacheable token is read from a cache file, to
+    /// record whatever handleToken() would have recorded about the program, e.g. the stacks it uses. The live and
+    /// reserved registers are set as they would have been for handleToken().
+    virtual void replayToken([[maybe_unused]] const Instruction& token)
+    {
+    }
+
+    /// @brief Copies this PseudoOpCode, along with everything it has recorded, to expand a part of the program on
+    /// another thread against a copy of the symbol table. Called after the program is analyzed and before it is
+    /// expanded. The default, nullptr, means it cannot be copied, and keeps the program expanded on one thread.
+    [[nodiscard]] virtual std::unique_ptr<PseudoOpCode> clone() const
+    {
+        return nullptr;
+    }
+
+    /// @brief Takes over what a clone() recorded while expanding its part of the program, which follows every part
+    /// merged so far, as if this PseudoOpCode had expanded it. symbols maps the clone's symbols to this one's; set()
+    /// those the clone named differently, e.g. labels numbered in order of first use.
+    virtual void merge([[maybe_unused]] PseudoOpCode& clone, [[maybe_unused]] SymbolRemap& symbols)
+    {
+    }
+
+    /// @brief Writes a summary of what this PseudoOpCode did to the diagnostics, once the program has been translated.
+    virtual void report([[maybe_unused]] std::ostream& diagnostics)
+    {
+    }
+
+    /// @brief Tells this PseudoOpCode how deep each stack gets, as found before the program is expanded. Not called
+    /// when the depths are unknown, e.g. in streaming mode.
+    virtual void setStackDepths([[maybe_unused]] const StackDepths& depths)
+    {
+    }
 };
 
 
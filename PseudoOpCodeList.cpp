@@ -0,0 +1 @@
+#include "PseudoOpCodeList.h"
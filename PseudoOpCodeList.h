@@ -0,0 +1,58 @@
+#ifndef LC3_LANGUAGE_EXTENDER_PSEUDOOPCODELIST_H
+#define LC3_LANGUAGE_EXTENDER_PSEUDOOPCODELIST_H
+
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include "ArithmeticOpCode.h"
+#include "PseudoOpCode.h"
+#include "StackOperations.h"
+#include "StringPrintOpCode.h"
+#include "SubtractOpCode.h"
+
+/// @brief A list of PseudoOpCode types known at compile time. The expansion engine calls the PseudoOpCodes of these
+/// types as what they are rather than through the virtual interface, so their canHandle(), handleToken() and register
+/// effects can be inlined into the dispatch loop. Any other PseudoOpCode, e.g. a user-defined one, is still called
+/// virtually.
+/// The types must be final: an override in a class derived from one of them would be bypassed.
+template<typename... Types>
+class PseudoOpCodeList
+{
+    static_assert((std::is_final_v<Types> && ...), "Listed PseudoOpCodes must be final.");
+    static_assert(sizeof...(Types) < PseudoOpCode::UNLISTED, "Too many PseudoOpCode types.");
+
+public:
+    /// @brief The position of the PseudoOpCode's type in the list, or PseudoOpCode::UNLISTED.
+    static uint8_t indexOf(const PseudoOpCode& pseudoOpCode)
+    {
+        uint8_t result = PseudoOpCode::UNLISTED;
+        uint8_t index  = 0;
+        ((result = typeid(pseudoOpCode) == typeid(Types) ? index : result, index++), ...);
+        return result;
+    }
+
+    /// @brief Calls function with the PseudoOpCode as its listed type, going by its getListIndex(), or as a
+    /// PseudoOpCode if its type is not listed.
+    template<size_t Index = 0, typename Function>
+    static decltype(auto) visit(PseudoOpCode& pseudoOpCode, Function&& function)
+    {
+        if constexpr (Index < sizeof...(Types)) {
+            using Type = std::tuple_element_t<Index, std::tuple<Types...>>;
+            if (pseudoOpCode.getListIndex() == Index) {
+                return function(static_cast<Type&>(pseudoOpCode));
+            }
+            return visit<Index + 1>(pseudoOpCode, std::forward<Function>(function));
+        }
+        else {
+            return function(pseudoOpCode);
+        }
+    }
+};
+
+/// @brief The built-in PseudoOpCodes, as registered by registerBuiltinPseudoOpCodes().
+using BuiltinPseudoOpCodeList = PseudoOpCodeList<StackOperations, StringPrintOpCode, SubtractOpCode, ArithmeticOpCode>;
+
+
+#endif //LC3_LANGUAGE_EXTENDER_PSEUDOOPCODELIST_H
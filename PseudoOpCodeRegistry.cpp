@@ -0,0 +1 @@
+#include "PseudoOpCodeRegistry.h"
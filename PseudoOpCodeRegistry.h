@@ -0,0 +1,152 @@
+#ifndef LC3_LANGUAGE_EXTENDER_PSEUDOOPCODEREGISTRY_H
+#define LC3_LANGUAGE_EXTENDER_PSEUDOOPCODEREGISTRY_H
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Instruction.h"
+#include "PseudoOpCode.h"
+#include "PseudoOpCodeList.h"
+#include "SymbolTable.h"
+
+/// @brief Indexes PseudoOpCodes by the mnemonics they declare, so a line is only offered to the PseudoOpCodes that
+/// could possibly match it.
+class PseudoOpCodeRegistry
+{
+private:
+    struct StringHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view value) const
+        {
+            return std::hash<std::string_view>{}(value);
+        }
+    };
+
+    using Bucket = std::vector<PseudoOpCode*>;
+
+    SymbolTable& symbols;
+    std::vector<PseudoOpCode*> pseudoOpCodes;
+    // PseudoOpCodes which declared no mnemonics; these are offered every line.
+    Bucket                     universal;
+    std::unordered_map<std::string, Bucket, StringHash, std::equal_to<>> buckets;
+    // Resolved buckets for LC3 opcodes, and for the symbols naming pseudo-instructions, labels and raw lines.
+    std::array<const Bucket*, OPCODE_COUNT> opcodeBuckets{};
+    std::vector<const Bucket*>              symbolBuckets;
+
+    static void sortByPriority(Bucket& bucket)
+    {
+        std::stable_sort(bucket.begin(), bucket.end(), [](PseudoOpCode* a, PseudoOpCode* b) {
+            return a->getPriority() > b->getPriority();
+        });
+    }
+
+    void rebuild()
+    {
+        sortByPriority(pseudoOpCodes);
+        universal.clear();
+        buckets.clear();
+        for (auto pseudoOpCode: pseudoOpCodes) {
+            auto mnemonics = pseudoOpCode->getMnemonics();
+            if (mnemonics.empty()) {
+                universal.push_back(pseudoOpCode);
+                continue;
+            }
+            for (auto& mnemonic: mnemonics) {
+                auto& bucket = buckets[mnemonic];
+                if (std::find(bucket.begin(), bucket.end(), pseudoOpCode) == bucket.end()) {
+                    bucket.push_back(pseudoOpCode);
+                }
+            }
+        }
+        // Universal PseudoOpCodes still get to see lines which have a dedicated bucket.
+        for (auto& [_, bucket]: buckets) {
+            bucket.insert(bucket.end(), universal.begin(), universal.end());
+            sortByPriority(bucket);
+        }
+
+        for (size_t i = 0; i < static_cast<size_t>(Opcode::LABEL); i++) {
+            opcodeBuckets[i] = &findBucket(OPCODE_NAMES[i]);
+        }
+        symbolBuckets.clear();
+    }
+
+    /// @brief Finds the bucket for a leading word. Words containing an underscore are additionally looked up by their
+    /// prefix up to and including the first underscore; exact mnemonics win.
+    [[nodiscard]] const Bucket& findBucket(std::string_view word) const
+    {
+        if (auto it = buckets.find(word); it != buckets.end()) {
+            return it->second;
+        }
+        if (auto underscore = word.find('_'); underscore != std::string_view::npos) {
+            if (auto it = buckets.find(word.substr(0, underscore + 1)); it != buckets.end()) {
+                return it->second;
+            }
+        }
+        return universal;
+    }
+
+    const Bucket& findSymbolBucket(SymbolId id, bool leadingWordOnly)
+    {
+        if (id >= symbolBuckets.size()) {
+            symbolBuckets.resize(symbols.size(), nullptr);
+        }
+        if (symbolBuckets[id] == nullptr) {
+            std::string_view word = symbols.getName(id);
+            if (leadingWordOnly) {
+                word = word.substr(0, word.find_first_of(" \t"));
+            }
+            symbolBuckets[id] = &findBucket(word);
+        }
+        return *symbolBuckets[id];
+    }
+
+public:
+    explicit PseudoOpCodeRegistry(SymbolTable& symbols) : symbols(symbols)
+    {
+        rebuild();
+    }
+
+    void add(PseudoOpCode* pseudoOpCode)
+    {
+        pseudoOpCode->setSymbolTable(symbols);
+        pseudoOpCode->setListIndex(BuiltinPseudoOpCodeList::indexOf(*pseudoOpCode));
+        pseudoOpCodes.push_back(pseudoOpCode);
+        rebuild();
+    }
+
+    [[nodiscard]] SymbolTable& getSymbolTable()
+    {
+        return symbols;
+    }
+
+    /// @brief All registered PseudoOpCodes, highest priority first.
+    [[nodiscard]] const std::vector<PseudoOpCode*>& getAll() const
+    {
+        return pseudoOpCodes;
+    }
+
+    /// @brief Returns the PseudoOpCodes which may be able to handle the given instruction, highest priority first.
+    /// LC3 instructions are resolved through a table indexed by opcode; pseudo-instructions, labels and raw lines by
+    /// the symbol naming them, with the result cached per symbol so each name is only hashed once.
+    [[nodiscard]] const std::vector<PseudoOpCode*>& getCandidates(const Instruction& instruction)
+    {
+        switch (instruction.opcode) {
+            case Opcode::PSEUDO:
+                return findSymbolBucket(instruction.mnemonic, false);
+            case Opcode::LABEL:
+                return findSymbolBucket(instruction.definedLabel, false);
+            case Opcode::RAW:
+                return findSymbolBucket(instruction.mnemonic, true);
+            default:
+                return *opcodeBuckets[static_cast<size_t>(instruction.opcode)];
+        }
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_PSEUDOOPCODEREGISTRY_H
@@ -0,0 +1,138 @@
+#ifndef LC3_LANGUAGE_EXTENDER_REGISTEREFFECTS_H
+#define LC3_LANGUAGE_EXTENDER_REGISTEREFFECTS_H
+
+#include <cstdint>
+#include "Instruction.h"
+
+/// @brief A set of the registers R0 to R7, one bit per register.
+using RegisterSet = uint8_t;
+
+constexpr RegisterSet NO_REGISTERS  = 0;
+constexpr RegisterSet ALL_REGISTERS = 0xFF;
+
+constexpr RegisterSet registerBit(int r)
+{
+    return static_cast<RegisterSet>(1 << r);
+}
+
+/// @brief Where execution continues after an instruction.
+enum class ControlFlow : uint8_t
+{
+    /// @brief The next instruction.
+    Next,
+    /// @brief The instruction's label operand, and the next instruction unless the branch is unconditional.
+    Branch,
+    /// @brief Anywhere; everything is assumed to be used there.
+    Unknown,
+    /// @brief Nowhere, the program has ended. The registers are left for whoever inspects the machine afterwards.
+    Halt,
+};
+
+/// @brief What an instruction does to the registers and condition codes, as far as liveness is concerned.
+/// reads may over-approximate and writes under-approximate: writes only lists registers which are certainly
+/// overwritten, so analyses built on these stay correct.
+struct RegisterEffects
+{
+    RegisterSet reads               = NO_REGISTERS;
+    RegisterSet writes              = NO_REGISTERS;
+    bool        readsConditionCodes = false;
+    bool        setsConditionCodes  = false;
+    ControlFlow flow                = ControlFlow::Next;
+
+    /// @brief The effects of something nothing is known about: it may read everything and go anywhere.
+    static RegisterEffects unknown()
+    {
+        return {ALL_REGISTERS, NO_REGISTERS, true, false, ControlFlow::Unknown};
+    }
+
+    /// @brief The effects of an LC3 instruction or directive. Pseudo-instructions and raw lines are unknown.
+    static RegisterEffects of(const Instruction& instruction)
+    {
+        RegisterEffects effects;
+        const auto&     r = instruction.registers;
+        switch (instruction.opcode) {
+            case Opcode::ADD:
+            case Opcode::AND:
+                effects.reads = registerBit(r[1]) | (instruction.registerCount == 3 ? registerBit(r[2]) : 0);
+                effects.writes             = registerBit(r[0]);
+                effects.setsConditionCodes = true;
+                break;
+            case Opcode::NOT:
+            case Opcode::LDR:
+                effects.reads              = registerBit(r[1]);
+                effects.writes             = registerBit(r[0]);
+                effects.setsConditionCodes = true;
+                break;
+            case Opcode::LD:
+            case Opcode::LDI:
+                effects.writes             = registerBit(r[0]);
+                effects.setsConditionCodes = true;
+                break;
+            case Opcode::LEA:
+                // Older revisions of the ISA have LEA set the condition codes, newer ones don't; assume neither.
+                effects.writes = registerBit(r[0]);
+                break;
+            case Opcode::ST:
+            case Opcode::STI:
+                effects.reads = registerBit(r[0]);
+                break;
+            case Opcode::STR:
+                effects.reads = registerBit(r[0]) | registerBit(r[1]);
+                break;
+            case Opcode::BR:
+                effects.readsConditionCodes = true;
+                effects.flow                = instruction.label == NO_SYMBOL ? ControlFlow::Unknown
+                                                                             : ControlFlow::Branch;
+                break;
+            case Opcode::ORIG:
+            case Opcode::LABEL:
+                break;
+            case Opcode::GETC:
+            case Opcode::IN:
+                effects.writes = registerBit(0) | registerBit(7);
+                break;
+            case Opcode::OUT:
+            case Opcode::PUTS:
+            case Opcode::PUTSP:
+                effects.reads  = registerBit(0);
+                effects.writes = registerBit(7);
+                break;
+            case Opcode::HALT:
+                // The trap leaves its return address in R7 before the machine stops.
+                effects.reads = ALL_REGISTERS & ~registerBit(7);
+                effects.flow  = ControlFlow::Halt;
+                break;
+            case Opcode::TRAP:
+                // The standard service routines take their argument in, or return their result through, R0. The
+                // trap itself leaves the return address in R7.
+                if (instruction.immediate == 0x20 || instruction.immediate == 0x23) {
+                    effects.writes = registerBit(0) | registerBit(7);
+                    break;
+                }
+                if (instruction.immediate >= 0x21 && instruction.immediate <= 0x24) {
+                    effects.reads  = registerBit(0);
+                    effects.writes = registerBit(7);
+                    break;
+                }
+                if (instruction.immediate == 0x25) {
+                    effects.reads = ALL_REGISTERS & ~registerBit(7);
+                    effects.flow  = ControlFlow::Halt;
+                    break;
+                }
+                return unknown();
+            default:
+                return unknown();
+        }
+        return effects;
+    }
+
+    /// @brief Whether an unconditional branch, which never continues with the next instruction.
+    [[nodiscard]] static bool isUnconditional(const Instruction& instruction)
+    {
+        return instruction.conditionFlags == 0 ||
+               instruction.conditionFlags == (CONDITION_N | CONDITION_Z | CONDITION_P);
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_REGISTEREFFECTS_H
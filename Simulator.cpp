@@ -0,0 +1 @@
+#include "Simulator.h"
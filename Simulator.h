@@ -0,0 +1,354 @@
+#ifndef LC3_LANGUAGE_EXTENDER_SIMULATOR_H
+#define LC3_LANGUAGE_EXTENDER_SIMULATOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Assembler.h"
+#include "Instruction.h"
+#include "SymbolTable.h"
+
+/// @brief What the simulated program did, in total or attributed to some part of it.
+struct ExecutionCounts
+{
+    uint64_t instructions = 0;
+    /// @brief Data reads and writes; instruction fetches are not counted.
+    uint64_t reads        = 0;
+    uint64_t writes       = 0;
+
+    ExecutionCounts& operator+=(const ExecutionCounts& other)
+    {
+        instructions += other.instructions;
+        reads += other.reads;
+        writes += other.writes;
+        return *this;
+    }
+};
+
+/// @brief Runs an assembled program on a simulated LC3, counting what every line of the program costs.
+/// Traps are not run as operating system code: GETC, OUT, PUTS, IN, PUTSP and HALT are serviced by stubs reading input
+/// and writing console, and count as a single instruction plus the memory the service itself reads (e.g. each character
+/// of a PUTS). Device registers are not simulated, they are plain memory.
+class Simulator
+{
+public:
+    enum class Outcome
+    {
+        Halted,
+        /// @brief GETC or IN was executed with no input left.
+        InputExhausted,
+        /// @brief The instruction limit was reached first.
+        LimitReached,
+        /// @brief An RTI, reserved opcode or unknown trap was executed.
+        IllegalInstruction,
+    };
+
+    /// @brief Programs which have not halted after this many instructions are stopped.
+    static constexpr uint64_t DEFAULT_INSTRUCTION_LIMIT = 100'000'000;
+
+private:
+    /// @brief Attributed counts of words outside the program, e.g. code reached by a wild jump.
+    static constexpr size_t OUTSIDE_PROGRAM = static_cast<size_t>(-1);
+    /// @brief The number of source lines the report lists.
+    static constexpr size_t REPORTED_SOURCE_LINES = 20;
+
+    const std::vector<Instruction>& program;
+    const SymbolTable&              symbols;
+    std::vector<uint16_t>           memory = std::vector<uint16_t>(0x10000, 0);
+    /// @brief The program line each address was assembled from, or OUTSIDE_PROGRAM.
+    std::vector<size_t>             lineAt = std::vector<size_t>(0x10000, OUTSIDE_PROGRAM);
+    uint16_t                        registers[8] = {};
+    uint16_t                        pc           = 0;
+    uint8_t                         condition    = CONDITION_Z;
+    uint64_t                        instructionLimit = DEFAULT_INSTRUCTION_LIMIT;
+    /// @brief Counts by program line, with the last entry for words outside the program.
+    std::vector<ExecutionCounts>    counts;
+    ExecutionCounts                 total;
+    Outcome                         outcome = Outcome::Halted;
+
+    ExecutionCounts& countsAt(uint16_t address)
+    {
+        size_t line = lineAt[address];
+        return counts[line == OUTSIDE_PROGRAM ? program.size() : line];
+    }
+
+    uint16_t read(uint16_t address, ExecutionCounts& counter)
+    {
+        counter.reads++;
+        return memory[address];
+    }
+
+    void write(uint16_t address, uint16_t value, ExecutionCounts& counter)
+    {
+        counter.writes++;
+        memory[address] = value;
+    }
+
+    void setCondition(uint16_t value)
+    {
+        auto signedValue = static_cast<int16_t>(value);
+        condition = signedValue < 0 ? CONDITION_N : signedValue == 0 ? CONDITION_Z : CONDITION_P;
+    }
+
+    void load(uint16_t r, uint16_t value)
+    {
+        registers[r] = value;
+        setCondition(value);
+    }
+
+    static int32_t signExtend(uint16_t word, int bits)
+    {
+        int32_t value = word & ((1 << bits) - 1);
+        return value & (1 << (bits - 1)) ? value - (1 << bits) : value;
+    }
+
+    /// @brief Services a trap. Returns false if the program stops.
+    bool serviceTrap(uint8_t vector, std::istream& input, std::ostream& console, ExecutionCounts& counter)
+    {
+        switch (vector) {
+            case 0x20:
+            case 0x23: {
+                if (vector == 0x23) {
+                    console << "Input a character> ";
+                }
+                int c = input.get();
+                if (c == std::char_traits<char>::eof()) {
+                    outcome = Outcome::InputExhausted;
+                    return false;
+                }
+                registers[0] = static_cast<uint16_t>(c);
+                if (vector == 0x23) {
+                    console.put(static_cast<char>(c));
+                }
+                return true;
+            }
+            case 0x21:
+                console.put(static_cast<char>(registers[0] & 0xFF));
+                return true;
+            case 0x22:
+                for (uint16_t address = registers[0];; address++) {
+                    uint16_t word = read(address, counter);
+                    if (word == 0) {
+                        break;
+                    }
+                    console.put(static_cast<char>(word & 0xFF));
+                }
+                return true;
+            case 0x24:
+                for (uint16_t address = registers[0];; address++) {
+                    uint16_t word = read(address, counter);
+                    if ((word & 0xFF) == 0) {
+                        break;
+                    }
+                    console.put(static_cast<char>(word & 0xFF));
+                    if ((word >> 8) == 0) {
+                        break;
+                    }
+                    console.put(static_cast<char>(word >> 8));
+                }
+                return true;
+            case 0x25:
+                outcome = Outcome::Halted;
+                return false;
+            default:
+                outcome = Outcome::IllegalInstruction;
+                return false;
+        }
+    }
+
+    /// @brief Executes the instruction at pc. Returns false if the program stops.
+    bool step(std::istream& input, std::ostream& console)
+    {
+        auto& counter = countsAt(pc);
+        counter.instructions++;
+        uint16_t word = memory[pc++];
+        uint16_t dr   = (word >> 9) & 0x7;
+        uint16_t sr1  = (word >> 6) & 0x7;
+        switch (word >> 12) {
+            case 0x1: // ADD
+            case 0x5: // AND
+            {
+                uint16_t operand = word & 0x20 ? static_cast<uint16_t>(signExtend(word, 5)) : registers[word & 0x7];
+                load(dr, word >> 12 == 0x1 ? registers[sr1] + operand : registers[sr1] & operand);
+                return true;
+            }
+            case 0x9: // NOT
+                load(dr, ~registers[sr1]);
+                return true;
+            case 0x0: // BR
+                if (dr & condition) {
+                    pc += signExtend(word, 9);
+                }
+                return true;
+            case 0xC: // JMP, RET
+                pc = registers[sr1];
+                return true;
+            case 0x4: // JSR, JSRR
+            {
+                uint16_t returnAddress = pc;
+                pc           = word & 0x800 ? static_cast<uint16_t>(pc + signExtend(word, 11)) : registers[sr1];
+                registers[7] = returnAddress;
+                return true;
+            }
+            case 0x2: // LD
+                load(dr, read(pc + signExtend(word, 9), counter));
+                return true;
+            case 0xA: // LDI
+                load(dr, read(read(pc + signExtend(word, 9), counter), counter));
+                return true;
+            case 0x6: // LDR
+                load(dr, read(registers[sr1] + signExtend(word, 6), counter));
+                return true;
+            case 0xE: // LEA
+                registers[dr] = pc + signExtend(word, 9);
+                return true;
+            case 0x3: // ST
+                write(pc + signExtend(word, 9), registers[dr], counter);
+                return true;
+            case 0xB: // STI
+                write(read(pc + signExtend(word, 9), counter), registers[dr], counter);
+                return true;
+            case 0x7: // STR
+                write(registers[sr1] + signExtend(word, 6), registers[dr], counter);
+                return true;
+            case 0xF: // TRAP
+                registers[7] = pc;
+                return serviceTrap(word & 0xFF, input, console, counter);
+            default: // RTI, reserved
+                outcome = Outcome::IllegalInstruction;
+                return false;
+        }
+    }
+
+    [[nodiscard]] std::string describeOutcome() const
+    {
+        switch (outcome) {
+            case Outcome::Halted:
+                return "halted";
+            case Outcome::InputExhausted:
+                return "stopped waiting for input";
+            case Outcome::LimitReached:
+                return "reached the limit of " + std::to_string(instructionLimit) + " instructions without halting";
+            case Outcome::IllegalInstruction:
+                return "stopped at an illegal instruction";
+        }
+        return "";
+    }
+
+    static void writeCounts(std::ostream& diagnostics, const ExecutionCounts& counts)
+    {
+        diagnostics << counts.instructions << " instructions, " << counts.reads << " reads, " << counts.writes
+                    << " writes";
+    }
+
+public:
+    /// @brief Loads the assembled program. The program must outlive the simulator.
+    Simulator(const std::vector<Instruction>& program, const SymbolTable& symbols) : program(program),
+                                                                                      symbols(symbols),
+                                                                                      counts(program.size() + 1)
+    {
+        Assembler assembler(symbols);
+        auto      image = assembler.assemble(program);
+        for (size_t i = 0; i < image.words.size(); i++) {
+            auto address    = static_cast<uint16_t>(image.origin + i);
+            memory[address] = image.words[i];
+            lineAt[address] = image.lines[i];
+        }
+        pc = image.origin;
+    }
+
+    void setInstructionLimit(uint64_t value)
+    {
+        instructionLimit = value;
+    }
+
+    /// @brief Runs the program from its origin until it halts or stops. GETC and IN read input, the console output is
+    /// written to console.
+    Outcome run(std::istream& input, std::ostream& console)
+    {
+        uint64_t executed = 0;
+        while (true) {
+            if (executed++ == instructionLimit) {
+                outcome = Outcome::LimitReached;
+                break;
+            }
+            if (!step(input, console)) {
+                break;
+            }
+        }
+        console << std::flush;
+        total = {};
+        for (auto& entry: counts) {
+            total += entry;
+        }
+        return outcome;
+    }
+
+    [[nodiscard]] const ExecutionCounts& getTotal() const
+    {
+        return total;
+    }
+
+    /// @brief The counts of every program line, and of words outside the program in the last entry.
+    [[nodiscard]] const std::vector<ExecutionCounts>& getCounts() const
+    {
+        return counts;
+    }
+
+    /// @brief Writes the counts by PseudoOpCode, and for the source lines which cost the most instructions.
+    /// source holds the source lines, so they can be quoted.
+    void report(std::ostream& diagnostics, const std::vector<std::string>& source) const
+    {
+        diagnostics << "Simulation " << describeOutcome() << " after ";
+        writeCounts(diagnostics, total);
+        diagnostics << ".\n";
+
+        // Ordered by name, so reports of different runs line up.
+        std::map<std::string_view, ExecutionCounts> byProducer;
+        std::map<uint32_t, ExecutionCounts>         bySourceLine;
+        for (size_t i = 0; i <= program.size(); i++) {
+            if (counts[i].instructions == 0 && counts[i].reads == 0 && counts[i].writes == 0) {
+                continue;
+            }
+            if (i == program.size()) {
+                byProducer["(outside the program)"] += counts[i];
+                continue;
+            }
+            auto& line = program[i];
+            byProducer[line.producer == NO_SYMBOL ? "(source)" : std::string_view(symbols.getName(line.producer))] +=
+                    counts[i];
+            if (line.sourceLine != 0) {
+                bySourceLine[line.sourceLine] += counts[i];
+            }
+        }
+        diagnostics << "By PseudoOpCode:\n";
+        for (auto& [name, entry]: byProducer) {
+            diagnostics << "  " << name << ": ";
+            writeCounts(diagnostics, entry);
+            diagnostics << "\n";
+        }
+
+        std::vector<std::pair<uint32_t, ExecutionCounts>> lines(bySourceLine.begin(), bySourceLine.end());
+        std::stable_sort(lines.begin(), lines.end(),
+                         [](auto& a, auto& b) { return a.second.instructions > b.second.instructions; });
+        lines.resize(std::min(lines.size(), REPORTED_SOURCE_LINES));
+        diagnostics << "By source line, most instructions first:\n";
+        for (auto& [number, entry]: lines) {
+            diagnostics << "  " << number << ": ";
+            writeCounts(diagnostics, entry);
+            if (number <= source.size()) {
+                diagnostics << "  " << source[number - 1];
+            }
+            diagnostics << "\n";
+        }
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_SIMULATOR_H
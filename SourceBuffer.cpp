@@ -0,0 +1 @@
+#include "SourceBuffer.h"
@@ -0,0 +1,146 @@
+#ifndef LC3_LANGUAGE_EXTENDER_SOURCEBUFFER_H
+#define LC3_LANGUAGE_EXTENDER_SOURCEBUFFER_H
+
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// @brief The whole text of a source file in one block: memory-mapped if it is a regular file, read in large blocks
+/// otherwise. The translator takes its lines as views into the block, so no line is ever copied on the way in.
+/// A mapped file must not be truncated while the buffer is alive.
+class SourceBuffer
+{
+private:
+    static constexpr size_t READ_BLOCK_BYTES = 1 << 20;
+
+    std::string text;
+    const char* mapping     = nullptr;
+    size_t      mappingSize = 0;
+
+    void release()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapping != nullptr) {
+            munmap(const_cast<char*>(mapping), mappingSize);
+        }
+#endif
+        mapping     = nullptr;
+        mappingSize = 0;
+    }
+
+    /// @brief Reads everything readBlock(destination, size) returns, in blocks of READ_BLOCK_BYTES. readBlock returns
+    /// the number of bytes it read, and 0 at the end.
+    template<typename ReadBlock>
+    void readAll(ReadBlock&& readBlock)
+    {
+        size_t filled = 0;
+        for (size_t read = 1; read > 0; filled += read) {
+            if (filled == text.size()) {
+                text.resize(filled + READ_BLOCK_BYTES);
+            }
+            read = readBlock(text.data() + filled, text.size() - filled);
+        }
+        text.resize(filled);
+    }
+
+public:
+    SourceBuffer() = default;
+
+    SourceBuffer(const SourceBuffer&)            = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    SourceBuffer(SourceBuffer&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            text        = std::move(other.text);
+            mapping     = std::exchange(other.mapping, nullptr);
+            mappingSize = std::exchange(other.mappingSize, 0);
+        }
+        return *this;
+    }
+
+    ~SourceBuffer()
+    {
+        release();
+    }
+
+    /// @brief Reads the rest of input.
+    static SourceBuffer read(std::istream& input)
+    {
+        SourceBuffer buffer;
+        buffer.readAll([&](char* data, size_t size) {
+            return static_cast<size_t>(input.rdbuf()->sgetn(data, static_cast<std::streamsize>(size)));
+        });
+        return buffer;
+    }
+
+    /// @brief Maps the file at path into memory, or reads it if it cannot be mapped (e.g. a pipe). Throws
+    /// std::runtime_error if it cannot be opened or read.
+    static SourceBuffer map(const std::filesystem::path& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("Unable to open " + path.string());
+        }
+        SourceBuffer buffer;
+        struct stat  status{};
+        if (fstat(file, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+            auto size    = static_cast<size_t>(status.st_size);
+            auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                close(file);
+                buffer.mapping     = static_cast<const char*>(mapping);
+                buffer.mappingSize = size;
+                return buffer;
+            }
+        }
+        bool failed = false;
+        buffer.readAll([&](char* data, size_t size) {
+            ssize_t count;
+            while ((count = ::read(file, data, size)) < 0 && errno == EINTR) {
+            }
+            failed = count < 0;
+            return count > 0 ? static_cast<size_t>(count) : 0;
+        });
+        close(file);
+        if (failed) {
+            throw std::runtime_error("Unable to read " + path.string());
+        }
+        return buffer;
+#else
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Unable to open " + path.string());
+        }
+        return read(input);
+#endif
+    }
+
+    [[nodiscard]] std::string_view getText() const
+    {
+        return mapping != nullptr ? std::string_view(mapping, mappingSize) : std::string_view(text);
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_SOURCEBUFFER_H
@@ -0,0 +1 @@
+#include "SourceGenerator.h"
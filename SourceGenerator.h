@@ -0,0 +1,141 @@
+#ifndef LC3_LANGUAGE_EXTENDER_SOURCEGENERATOR_H
+#define LC3_LANGUAGE_EXTENDER_SOURCEGENERATOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/// @brief What a generated program is made of. The weights give the share of body lines of each kind.
+struct SourceMix
+{
+    size_t   lines          = 10'000;
+    uint32_t plainWeight    = 4;
+    uint32_t stackWeight    = 3;
+    uint32_t subtractWeight = 1;
+    uint32_t printWeight    = 2;
+    /// @brief PUSH, POP and PEEK lines are spread across this many stacks.
+    size_t   stackCount     = 4;
+    /// @brief PRINT lines cycle through this many distinct strings.
+    size_t   stringCount    = 64;
+    uint32_t seed           = 1;
+};
+
+/// @brief Generates synthetic programs for benchmarking translation. The same mix always produces the same program.
+/// Every stack is popped before it is pushed past MAX_STACK_DEPTH, so stack storage stays small however long the
+/// program is, and one in every COMMENT_INTERVAL lines carries a comment for the stripping phase to remove.
+class SourceGenerator
+{
+private:
+    static constexpr size_t MAX_STACK_DEPTH  = 8;
+    static constexpr size_t COMMENT_INTERVAL = 8;
+
+    const SourceMix&    mix;
+    // The engine's raw output is specified by the standard, unlike the distributions, so it is used directly.
+    std::mt19937        random;
+    std::vector<size_t> depths;
+    size_t              nextString = 0;
+
+    uint32_t next(uint32_t bound)
+    {
+        return static_cast<uint32_t>(random() % bound);
+    }
+
+    std::string anyRegister()
+    {
+        return "R" + std::to_string(next(6));
+    }
+
+    void appendPlain(std::string& out)
+    {
+        switch (next(4)) {
+            case 0:
+                out += "ADD " + anyRegister() + ", " + anyRegister() + ", #" + std::to_string(next(16)) + "\n";
+                break;
+            case 1:
+                out += "AND " + anyRegister() + ", " + anyRegister() + ", " + anyRegister() + "\n";
+                break;
+            case 2:
+                out += "NOT " + anyRegister() + ", " + anyRegister() + "\n";
+                break;
+            default:
+                out += "LDR " + anyRegister() + ", " + anyRegister() + ", #" + std::to_string(next(8)) + "\n";
+                break;
+        }
+    }
+
+    void appendStackOperation(std::string& out)
+    {
+        size_t      stack = next(static_cast<uint32_t>(depths.size()));
+        std::string name  = "S" + std::to_string(stack);
+        auto&       depth = depths[stack];
+        bool        push  = depth == 0 || (depth < MAX_STACK_DEPTH && next(2) == 0);
+        if (push) {
+            depth++;
+            out += "PUSH_" + name + " " + anyRegister() + "\n";
+        }
+        else if (next(4) == 0) {
+            out += "PEEK_" + name + " " + anyRegister() + "\n";
+        }
+        else {
+            depth--;
+            out += "POP_" + name + " " + anyRegister() + "\n";
+        }
+    }
+
+    void appendSubtract(std::string& out)
+    {
+        out += "SUBTRACT " + anyRegister() + ", " + anyRegister() + ", ";
+        out += next(2) == 0 ? "#" + std::to_string(1 + next(15)) : anyRegister();
+        out += "\n";
+    }
+
+    void appendPrint(std::string& out)
+    {
+        out += "PRINT \"Benchmark string " + std::to_string(nextString) + "\"\n";
+        nextString = (nextString + 1) % mix.stringCount;
+    }
+
+public:
+    explicit SourceGenerator(const SourceMix& mix) : mix(mix), random(mix.seed),
+                                                    depths(std::max<size_t>(mix.stackCount, 1))
+    {
+    }
+
+    /// @brief Generates a program of mix.lines body lines between .ORIG and .END.
+    std::string generate()
+    {
+        uint32_t plain    = mix.plainWeight;
+        uint32_t stack    = plain + (mix.stackCount == 0 ? 0 : mix.stackWeight);
+        uint32_t subtract = stack + mix.subtractWeight;
+        uint32_t total    = subtract + (mix.stringCount == 0 ? 0 : mix.printWeight);
+
+        std::string out;
+        out.reserve(mix.lines * 24);
+        out += ".ORIG x3000\n";
+        for (size_t i = 0; i < mix.lines; i++) {
+            uint32_t kind = total == 0 ? 0 : next(total);
+            if (total == 0 || kind < plain) {
+                appendPlain(out);
+            }
+            else if (kind < stack) {
+                appendStackOperation(out);
+            }
+            else if (kind < subtract) {
+                appendSubtract(out);
+            }
+            else {
+                appendPrint(out);
+            }
+            if (i % COMMENT_INTERVAL == 0) {
+                out.insert(out.size() - 1, " ; generated line " + std::to_string(i));
+            }
+        }
+        out += "HALT\n.END\n";
+        return out;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_SOURCEGENERATOR_H
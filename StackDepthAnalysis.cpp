@@ -0,0 +1 @@
+#include "StackDepthAnalysis.h"
@@ -0,0 +1,215 @@
+#ifndef LC3_LANGUAGE_EXTENDER_STACKDEPTHANALYSIS_H
+#define LC3_LANGUAGE_EXTENDER_STACKDEPTHANALYSIS_H
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Instruction.h"
+#include "RegisterEffects.h"
+
+/// @brief What a token does to one stack: the net change of its depth, and how far above its starting depth the stack
+/// grows while the token runs.
+struct StackEffect
+{
+    SymbolId stack = NO_SYMBOL;
+    int      delta = 0;
+    int      peak  = 0;
+};
+
+/// @brief How deep a stack gets over the whole program, and how often it is used.
+struct StackDepth
+{
+    /// @brief The most values the stack ever holds at once. Only meaningful if the stack is bounded.
+    int    maximum     = 0;
+    /// @brief Set when some loop pushes more than it pops, so no bound exists.
+    bool   unbounded   = false;
+    /// @brief For an unbounded stack, the line of a push inside such a loop.
+    size_t growingLine = 0;
+    /// @brief The number of lines which use the stack.
+    size_t uses        = 0;
+};
+
+using StackDepths = std::unordered_map<SymbolId, StackDepth>;
+
+/// @brief Finds the maximum depth of every stack by following the control flow of a program.
+/// Branches and subroutine calls to labels defined within the program are followed; a subroutine is assumed to leave
+/// the stacks as it found them when it returns. Code which is only reached through a jump to a computed address is
+/// assumed to start with every stack empty.
+class StackDepthAnalysis
+{
+private:
+    static constexpr int UNREACHED = INT_MIN;
+
+    /// @brief The lines execution may continue at after each line: those of line i are
+    /// targets[offsets[i]] to targets[offsets[i + 1]].
+    struct ControlFlowGraph
+    {
+        std::vector<size_t> offsets;
+        std::vector<size_t> targets;
+    };
+
+    /// @brief Appends the lines execution may continue at after lines[i].
+    static void findSuccessors(const std::vector<Instruction>& lines, size_t i,
+                               const std::unordered_map<SymbolId, size_t>& labels, std::vector<size_t>& successors)
+    {
+        auto& line         = lines[i];
+        bool  fallsThrough = true;
+        auto  addLabel     = [&](SymbolId label) {
+            if (auto target = labels.find(label); target != labels.end()) {
+                successors.push_back(target->second);
+            }
+        };
+        switch (line.opcode) {
+            case Opcode::BR:
+                addLabel(line.label);
+                fallsThrough = !RegisterEffects::isUnconditional(line);
+                break;
+            case Opcode::JSR:
+                addLabel(line.label);
+                break;
+            case Opcode::JMP:
+            case Opcode::RET:
+            case Opcode::RTI:
+            case Opcode::HALT:
+            case Opcode::END:
+                fallsThrough = false;
+                break;
+            case Opcode::TRAP:
+                fallsThrough = line.immediate != 0x25;
+                break;
+            default:
+                break;
+        }
+        if (fallsThrough && i + 1 < lines.size()) {
+            successors.push_back(i + 1);
+        }
+    }
+
+    static ControlFlowGraph buildControlFlowGraph(const std::vector<Instruction>& lines)
+    {
+        std::unordered_map<SymbolId, size_t> labels;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (lines[i].definedLabel != NO_SYMBOL) {
+                labels.emplace(lines[i].definedLabel, i);
+            }
+        }
+        ControlFlowGraph graph;
+        graph.offsets.reserve(lines.size() + 1);
+        graph.targets.reserve(lines.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            graph.offsets.push_back(graph.targets.size());
+            findSuccessors(lines, i, labels, graph.targets);
+        }
+        graph.offsets.push_back(graph.targets.size());
+        return graph;
+    }
+
+    /// @brief Finds how deep a single stack gets, given the effect each line has on it.
+    static StackDepth analyzeStack(const ControlFlowGraph& graph, const std::vector<int>& delta,
+                                   const std::vector<int>& peak)
+    {
+        // On any path which visits no line twice the depth is at most the sum of all pushes, so a depth beyond that
+        // can only be reached by going round a loop which pushes more than it pops.
+        int bound = 0;
+        for (int d: delta) {
+            bound += std::max(d, 0);
+        }
+        StackDepth result;
+        if (bound == 0 && std::find_if(delta.begin(), delta.end(), [](int d) { return d != 0; }) == delta.end()) {
+            // Every line leaves the stack as it found it, so it is empty wherever a line starts.
+            result.maximum = *std::max_element(peak.begin(), peak.end());
+            return result;
+        }
+
+        size_t               count = delta.size();
+        std::vector<int>     entry(count, UNREACHED);
+        std::vector<uint8_t> queued(count, false);
+        std::vector<size_t>  worklist;
+        for (size_t root = 0; root < count; root++) {
+            if (entry[root] != UNREACHED) {
+                continue;
+            }
+            entry[root] = 0;
+            worklist.push_back(root);
+            queued[root] = true;
+            while (!worklist.empty()) {
+                size_t i = worklist.back();
+                worklist.pop_back();
+                queued[i] = false;
+                int exit  = entry[i] + delta[i];
+                if (exit > bound) {
+                    result.unbounded   = true;
+                    result.growingLine = i;
+                    return result;
+                }
+                for (size_t k = graph.offsets[i]; k < graph.offsets[i + 1]; k++) {
+                    size_t j = graph.targets[k];
+                    if (entry[j] == UNREACHED || exit > entry[j]) {
+                        entry[j] = exit;
+                        if (!queued[j]) {
+                            worklist.push_back(j);
+                            queued[j] = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            result.maximum = std::max(result.maximum, entry[i] + std::max(peak[i], delta[i]));
+        }
+        return result;
+    }
+
+public:
+    /// @brief effects holds what each line does to the stacks, or std::nullopt for lines nothing is known about; if
+    /// there is any such line, no stack can be bounded and std::nullopt is returned.
+    [[nodiscard]] static std::optional<StackDepths>
+    analyze(const std::vector<Instruction>& lines, const std::vector<std::optional<std::vector<StackEffect>>>& effects)
+    {
+        // The lines which touch each stack, in order of the stack's first use.
+        std::vector<std::pair<SymbolId, std::vector<size_t>>> stacks;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (!effects[i]) {
+                return std::nullopt;
+            }
+            for (auto& effect: *effects[i]) {
+                auto it = std::find_if(stacks.begin(), stacks.end(), [&](auto& s) { return s.first == effect.stack; });
+                if (it == stacks.end()) {
+                    it = stacks.insert(stacks.end(), {effect.stack, {}});
+                }
+                it->second.push_back(i);
+            }
+        }
+
+        auto             graph = buildControlFlowGraph(lines);
+        StackDepths      result;
+        std::vector<int> delta(lines.size(), 0);
+        std::vector<int> peak(lines.size(), 0);
+        for (auto& [stack, users]: stacks) {
+            for (size_t i: users) {
+                for (auto& effect: *effects[i]) {
+                    if (effect.stack == stack) {
+                        peak[i] = std::max(peak[i], delta[i] + effect.peak);
+                        delta[i] += effect.delta;
+                    }
+                }
+            }
+            auto depth = analyzeStack(graph, delta, peak);
+            depth.uses = users.size();
+            result.emplace(stack, depth);
+            for (size_t i: users) {
+                delta[i] = 0;
+                peak[i]  = 0;
+            }
+        }
+        return result;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_STACKDEPTHANALYSIS_H
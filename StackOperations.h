@@ -5,180 +5,764 @@
 #ifndef LC3_LANGUAGE_EXTENDER_STACKOPERATIONS_H
 #define LC3_LANGUAGE_EXTENDER_STACKOPERATIONS_H
 
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "PseudoOpCode.h"
-#include <regex>
 
-class StackOperations : public PseudoOpCode
+/// @brief How stack operations are expanded.
+enum class StackExpansion
+{
+    /// @brief Every operation is expanded in place: fastest, but largest.
+    Inline,
+    /// @brief Every operation calls a subroutine shared by all operations of its kind, stack and register.
+    Outlined,
+    /// @brief Only stacks which are used often are outlined.
+    Hybrid,
+};
+
+class StackOperations final : public PseudoOpCode
 {
 private:
-    std::vector<std::string> stackNames;
+    /// @brief The storage of a stack whose depth is not known statically.
+    static constexpr int DEFAULT_CAPACITY = 32;
+
+    enum class Operation
+    {
+        Push,
+        Pop,
+        Peek,
+    };
+
+    /// @brief A stack kept in memory has its pointer in stackPointer; a stack kept in a register grows down from base,
+    /// the word just past its storage.
+    struct Stack
+    {
+        SymbolId name;
+        SymbolId stackPointer          = NO_SYMBOL;
+        SymbolId temporarySaveLocation = NO_SYMBOL;
+        SymbolId storage               = NO_SYMBOL;
+        SymbolId base                  = NO_SYMBOL;
+        /// @brief Counts the slots still free, for stacks whose bounds are checked at runtime; NO_SYMBOL otherwise.
+        SymbolId freeSlots             = NO_SYMBOL;
+        /// @brief The register holding the stack pointer, or -1 if it is kept in memory.
+        int      stackRegister         = -1;
+        /// @brief The number of values the storage holds.
+        int      capacity              = DEFAULT_CAPACITY;
+    };
+
+    struct StackMnemonic
+    {
+        Operation operation;
+        SymbolId  stackName;
+    };
+
+    /// @brief An operation on one stack and register, as a subroutine which preserves every other register.
+    struct Subroutine
+    {
+        SymbolId                 stackName;
+        SymbolId                 mnemonic;
+        int                      targetRegister;
+        std::vector<Instruction> body;
+        /// @brief Whether some operation calls it, so it has to be emitted.
+        bool                     called = false;
+    };
 
-    std::tuple<std::string, std::string, std::string> getStackComponents(const std::string& stackName)
+    /// @brief The code size of a stack's operations, as they are inlined and as they are outlined.
+    struct CodeSize
     {
-        // If stackNames does not contain stackName, add it.
-        if (std::find(stackNames.begin(), stackNames.end(), stackName) == stackNames.end()) {
-            stackNames.push_back(stackName);
+        size_t operations  = 0;
+        size_t inlineWords = 0;
+        /// @brief Words at the call sites; the subroutines come on top.
+        size_t callWords   = 0;
+    };
+
+    // Stacks in order of first use, and their index by name.
+    std::vector<Stack>                                         stacks;
+    std::unordered_map<SymbolId, size_t>                       stackIndices;
+    // Parsed PUSH_/POP_/PEEK_ mnemonics; std::nullopt for mnemonics which turned out not to be stack operations.
+    std::unordered_map<SymbolId, std::optional<StackMnemonic>> stackMnemonics;
+    // Stacks whose pointer is kept in a register, by name.
+    std::unordered_map<std::string, int>                       stackRegisters;
+    // How deep each stack gets, when known.
+    StackDepths                                                stackDepths;
+    bool                                                       boundsChecking    = false;
+    StackExpansion                                             expansion         = StackExpansion::Inline;
+    size_t                                                     outlineThreshold  = 0;
+    // Set once an expansion mode was chosen explicitly, which asks for a code size report.
+    bool                                                       reportingCodeSize = false;
+    // Subroutines in order of first use, and their index by mnemonic and register.
+    std::vector<Subroutine>                                    subroutines;
+    std::unordered_map<uint64_t, size_t>                       subroutineIndices;
+    std::unordered_map<SymbolId, CodeSize>                     codeSizes;
+    // Holds R7 across a call, when the code around it still needs the return address it holds.
+    SymbolId                                                   returnAddressSaveLocation = NO_SYMBOL;
+
+    /// @brief Splits PUSH_${STACK_NAME}, POP_${STACK_NAME} or PEEK_${STACK_NAME} into its operation and stack name.
+    /// Each distinct mnemonic is only parsed once.
+    const std::optional<StackMnemonic>& parseMnemonic(SymbolId mnemonic)
+    {
+        if (auto it = stackMnemonics.find(mnemonic); it != stackMnemonics.end()) {
+            return it->second;
+        }
+
+        auto&                    symbols = getSymbolTable();
+        std::string_view         name    = symbols.getName(mnemonic);
+        std::optional<Operation> operation;
+        for (auto [prefix, value]: {std::pair{std::string_view("PUSH_"), Operation::Push},
+                                    {std::string_view("POP_"), Operation::Pop},
+                                    {std::string_view("PEEK_"), Operation::Peek}}) {
+            if (name.starts_with(prefix)) {
+                operation = value;
+                name.remove_prefix(prefix.size());
+                break;
+            }
+        }
+        std::optional<StackMnemonic> result;
+        if (operation && !name.empty() &&
+            std::all_of(name.begin(), name.end(), [](char c) { return isalnum(static_cast<unsigned char>(c)); })) {
+            result = StackMnemonic{*operation, symbols.intern(name)};
         }
-        return {"__stack_impl_" + stackName + "_stack_ptr", "__stack_impl_" + stackName + "_temp_save_location",
-                "__stack_impl_" + stackName + "_storage"};
+        return stackMnemonics.emplace(mnemonic, result).first->second;
     }
 
-    std::vector<std::string> handlePushOperation(const std::string& stackName, int targetRegister)
+    /// @brief Returns the labels of the named stack, registering it on first use.
+    const Stack& getStack(SymbolId stackName)
     {
-        auto [stackPointer, temporarySaveLocation, _] = getStackComponents(stackName);
-        int  tempRegister                             = (targetRegister + 1) % 7;
-        // ST ${tempRegister}, ${temporarySaveLocation}
-        // LD ${tempRegister}, ${stackPointer}
-        // ADD ${tempRegister}, ${tempRegister}, #1
-        // ST ${tempRegister}, ${stackPointer}
-        // STI ${targetRegister}, ${stackPointer}
-        // LD ${tempRegister}, ${temporarySaveLocation}
+        if (auto it = stackIndices.find(stackName); it != stackIndices.end()) {
+            return stacks[it->second];
+        }
+
+        auto&       symbols = getSymbolTable();
+        const auto& name    = symbols.getName(stackName);
+        Stack       stack{stackName};
+        bool        checked = false;
+        if (auto it = stackDepths.find(stackName); it != stackDepths.end()) {
+            // A stack which may grow without bound keeps the default size, and is checked if asked for.
+            checked = it->second.unbounded && boundsChecking;
+            if (!it->second.unbounded) {
+                stack.capacity = std::max(it->second.maximum, 1);
+            }
+        }
+        if (checked) {
+            stack.freeSlots = symbols.derive(stackName, SymbolRole::StackFreeSlots,
+                                             [&] { return "__stack_impl_" + name + "_free_slots"; });
+        }
+        if (auto it = stackRegisters.find(name); it != stackRegisters.end()) {
+            stack.stackRegister = it->second;
+            stack.storage       = symbols.derive(stackName, SymbolRole::StackStorage,
+                                                 [&] { return "__stack_impl_" + name + "_storage"; });
+            stack.base          = symbols.derive(stackName, SymbolRole::StackBase,
+                                                 [&] { return "__stack_impl_" + name + "_stack_base"; });
+            if (checked) {
+                stack.temporarySaveLocation = symbols.derive(stackName, SymbolRole::StackSaveLocation, [&] {
+                    return "__stack_impl_" + name + "_temp_save_location";
+                });
+            }
+        }
+        else {
+            stack.stackPointer          = symbols.derive(stackName, SymbolRole::StackPointer,
+                                                         [&] { return "__stack_impl_" + name + "_stack_ptr"; });
+            stack.temporarySaveLocation = symbols.derive(stackName, SymbolRole::StackSaveLocation, [&] {
+                return "__stack_impl_" + name + "_temp_save_location";
+            });
+            stack.storage               = symbols.derive(stackName, SymbolRole::StackStorage,
+                                                         [&] { return "__stack_impl_" + name + "_storage"; });
+        }
+        stackIndices.emplace(stackName, stacks.size());
+        stacks.push_back(stack);
+        return stacks.back();
+    }
+
+    /// @brief Picks a scratch register other than the target. Returns true if every register is live, so the scratch
+    /// register has to be saved and restored around its use.
+    std::pair<int, bool> chooseScratchRegister(int targetRegister)
+    {
+        if (auto scratchRegister = findDeadRegister(registerBit(targetRegister), (targetRegister + 1) % 7)) {
+            return {*scratchRegister, false};
+        }
+        int tempRegister = (targetRegister + 1) % 7;
+        while ((getReservedRegisters() & registerBit(tempRegister)) || tempRegister == targetRegister) {
+            tempRegister = (tempRegister + 1) % 7;
+        }
+        return {tempRegister, true};
+    }
 
-        std::vector<std::string> result;
-        result.push_back("STI R" + std::to_string(targetRegister) + ", " + stackPointer);
-        result.push_back("ST R" + std::to_string(tempRegister) + ", " + temporarySaveLocation);
-        result.push_back("LD R" + std::to_string(tempRegister) + ", " + stackPointer);
-        result.push_back("ADD R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister) + ", #1");
-        result.push_back("ST R" + std::to_string(tempRegister) + ", " + stackPointer);
-        result.push_back("LD R" + std::to_string(tempRegister) + ", " + temporarySaveLocation);
+    /// @brief A push onto a stack whose bounds are checked: a slot is claimed before anything is stored, and the
+    /// machine halts if none is left rather than overwrite whatever follows the storage.
+    std::vector<Instruction> handleCheckedPushOperation(const Stack& stack, int targetRegister)
+    {
+        // ST ${scratchRegister}, ${temporarySaveLocation}     (if it is live)
+        // LD ${scratchRegister}, ${freeSlots}
+        // ADD ${scratchRegister}, ${scratchRegister}, #-1
+        // BRzp #1
+        // HALT
+        // ST ${scratchRegister}, ${freeSlots}
+        // ...the push itself, restoring the scratch register once it is no longer needed
+        auto [r, preserve] = chooseScratchRegister(targetRegister);
+        auto branch        = Instruction::create(Opcode::BR).withImmediate(1);
+        branch.conditionFlags = CONDITION_Z | CONDITION_P;
+
+        std::vector<Instruction> result;
+        if (preserve) {
+            result.push_back(Instruction::create(Opcode::ST, {r}).withLabel(stack.temporarySaveLocation));
+        }
+        result.push_back(Instruction::create(Opcode::LD, {r}).withLabel(stack.freeSlots));
+        result.push_back(Instruction::create(Opcode::ADD, {r, r}).withImmediate(-1));
+        result.push_back(branch);
+        result.push_back(Instruction::create(Opcode::HALT));
+        result.push_back(Instruction::create(Opcode::ST, {r}).withLabel(stack.freeSlots));
+        if (stack.stackRegister >= 0) {
+            if (preserve) {
+                result.push_back(Instruction::create(Opcode::LD, {r}).withLabel(stack.temporarySaveLocation));
+            }
+            int sp = stack.stackRegister;
+            result.push_back(Instruction::create(Opcode::ADD, {sp, sp}).withImmediate(-1));
+            result.push_back(Instruction::create(Opcode::STR, {targetRegister, sp}).withImmediate(0));
+            return result;
+        }
+        result.push_back(Instruction::create(Opcode::STI, {targetRegister}).withLabel(stack.stackPointer));
+        result.push_back(Instruction::create(Opcode::LD, {r}).withLabel(stack.stackPointer));
+        result.push_back(Instruction::create(Opcode::ADD, {r, r}).withImmediate(1));
+        result.push_back(Instruction::create(Opcode::ST, {r}).withLabel(stack.stackPointer));
+        if (preserve) {
+            result.push_back(Instruction::create(Opcode::LD, {r}).withLabel(stack.temporarySaveLocation));
+        }
         return result;
     }
 
-    std::vector<std::string> handlePopOperation(const std::string& stackName, int targetRegister)
+    std::vector<Instruction> handlePushOperation(SymbolId stackName, int targetRegister)
     {
-        auto [stackPointer, temporarySaveLocation, _] = getStackComponents(stackName);
-        int  tempRegister                             = (targetRegister + 1) % 7;
+        auto& stack = getStack(stackName);
+        if (stack.freeSlots != NO_SYMBOL) {
+            return handleCheckedPushOperation(stack, targetRegister);
+        }
+        if (stack.stackRegister >= 0) {
+            // ADD ${stackRegister}, ${stackRegister}, #-1
+            // STR ${targetRegister}, ${stackRegister}, #0
+            int sp = stack.stackRegister;
+            return {Instruction::create(Opcode::ADD, {sp, sp}).withImmediate(-1),
+                    Instruction::create(Opcode::STR, {targetRegister, sp}).withImmediate(0)};
+        }
+
+        auto stackPointer                 = stack.stackPointer;
+        auto temporarySaveLocation        = stack.temporarySaveLocation;
+        auto [tempRegister, preserveTemp] = chooseScratchRegister(targetRegister);
+        if (!preserveTemp) {
+            // STI ${targetRegister}, ${stackPointer}
+            // LD ${scratchRegister}, ${stackPointer}
+            // ADD ${scratchRegister}, ${scratchRegister}, #1
+            // ST ${scratchRegister}, ${stackPointer}
+            int r = tempRegister;
+            return {Instruction::create(Opcode::STI, {targetRegister}).withLabel(stackPointer),
+                    Instruction::create(Opcode::LD, {r}).withLabel(stackPointer),
+                    Instruction::create(Opcode::ADD, {r, r}).withImmediate(1),
+                    Instruction::create(Opcode::ST, {r}).withLabel(stackPointer)};
+        }
+
+        // Every register is live, so one has to be saved and restored around its use.
+        // STI ${targetRegister}, ${stackPointer}
         // ST ${tempRegister}, ${temporarySaveLocation}
         // LD ${tempRegister}, ${stackPointer}
-        // ADD ${tempRegister}, ${tempRegister}, #-1
+        // ADD ${tempRegister}, ${tempRegister}, #1
         // ST ${tempRegister}, ${stackPointer}
-        // LDI ${targetRegister}, ${stackPointer}
         // LD ${tempRegister}, ${temporarySaveLocation}
 
-        std::vector<std::string> result;
-        result.push_back("ST R" + std::to_string(tempRegister) + ", " + temporarySaveLocation);
-        result.push_back("LD R" + std::to_string(tempRegister) + ", " + stackPointer);
-        result.push_back("ADD R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister) + ", #-1");
-        result.push_back("ST R" + std::to_string(tempRegister) + ", " + stackPointer);
-        result.push_back("LDI R" + std::to_string(targetRegister) + ", " + stackPointer);
-        result.push_back("LD R" + std::to_string(tempRegister) + ", " + temporarySaveLocation);
-        return result;
+        return {Instruction::create(Opcode::STI, {targetRegister}).withLabel(stackPointer),
+                Instruction::create(Opcode::ST, {tempRegister}).withLabel(temporarySaveLocation),
+                Instruction::create(Opcode::LD, {tempRegister}).withLabel(stackPointer),
+                Instruction::create(Opcode::ADD, {tempRegister, tempRegister}).withImmediate(1),
+                Instruction::create(Opcode::ST, {tempRegister}).withLabel(stackPointer),
+                Instruction::create(Opcode::LD, {tempRegister}).withLabel(temporarySaveLocation)};
     }
 
-    std::vector<std::string> handlePeekOperation(const std::string& stackName, int targetRegister)
+    std::vector<Instruction> handlePopOperation(SymbolId stackName, int targetRegister)
     {
-        auto [stackPointer, temporarySaveLocation, _] = getStackComponents(stackName);
-        int  tempRegister                             = (targetRegister + 1) % 7;
-        // ST ${tempRegister}, ${temporarySaveLocation}
-        // LD ${tempRegister}, ${stackPointer}
-        // LDI ${targetRegister}, ${stackPointer}
-        // LD ${tempRegister}, ${temporarySaveLocation}
+        auto&                    stack = getStack(stackName);
+        std::vector<Instruction> result;
+        if (stack.freeSlots != NO_SYMBOL) {
+            // The slot is handed back first, while the target register is still free to use.
+            // LD ${targetRegister}, ${freeSlots}
+            // ADD ${targetRegister}, ${targetRegister}, #1
+            // ST ${targetRegister}, ${freeSlots}
+            result = {Instruction::create(Opcode::LD, {targetRegister}).withLabel(stack.freeSlots),
+                      Instruction::create(Opcode::ADD, {targetRegister, targetRegister}).withImmediate(1),
+                      Instruction::create(Opcode::ST, {targetRegister}).withLabel(stack.freeSlots)};
+        }
+        if (stack.stackRegister >= 0) {
+            // LDR ${targetRegister}, ${stackRegister}, #0
+            // ADD ${stackRegister}, ${stackRegister}, #1
+            int sp = stack.stackRegister;
+            result.push_back(Instruction::create(Opcode::LDR, {targetRegister, sp}).withImmediate(0));
+            result.push_back(Instruction::create(Opcode::ADD, {sp, sp}).withImmediate(1));
+            return result;
+        }
+
+        auto stackPointer = stack.stackPointer;
+        // The target register is overwritten anyway, so it doubles as the scratch register.
+        // LD ${targetRegister}, ${stackPointer}
+        // ADD ${targetRegister}, ${targetRegister}, #-1
+        // ST ${targetRegister}, ${stackPointer}
+        // LDR ${targetRegister}, ${targetRegister}, #0
 
-        std::vector<std::string> result;
-        result.push_back("ST R" + std::to_string(tempRegister) + ", " + temporarySaveLocation);
-        result.push_back("LD R" + std::to_string(tempRegister) + ", " + stackPointer);
-        result.push_back("LDI R" + std::to_string(targetRegister) + ", " + stackPointer);
-        result.push_back("LD R" + std::to_string(tempRegister) + ", " + temporarySaveLocation);
+        result.push_back(Instruction::create(Opcode::LD, {targetRegister}).withLabel(stackPointer));
+        result.push_back(Instruction::create(Opcode::ADD, {targetRegister, targetRegister}).withImmediate(-1));
+        result.push_back(Instruction::create(Opcode::ST, {targetRegister}).withLabel(stackPointer));
+        result.push_back(Instruction::create(Opcode::LDR, {targetRegister, targetRegister}).withImmediate(0));
         return result;
     }
 
+    std::vector<Instruction> handlePeekOperation(SymbolId stackName, int targetRegister)
+    {
+        auto& stack = getStack(stackName);
+        if (stack.stackRegister >= 0) {
+            // LDR ${targetRegister}, ${stackRegister}, #0
+            return {Instruction::create(Opcode::LDR, {targetRegister, stack.stackRegister}).withImmediate(0)};
+        }
+
+        auto stackPointer = stack.stackPointer;
+        // The stack pointer points at the first free slot, the top of the stack is just below it.
+        // LD ${targetRegister}, ${stackPointer}
+        // LDR ${targetRegister}, ${targetRegister}, #-1
+
+        return {Instruction::create(Opcode::LD, {targetRegister}).withLabel(stackPointer),
+                Instruction::create(Opcode::LDR, {targetRegister, targetRegister}).withImmediate(-1)};
+    }
+
+    std::vector<Instruction> expandInline(Operation operation, SymbolId stackName, int targetRegister)
+    {
+        switch (operation) {
+            case Operation::Push:
+                return handlePushOperation(stackName, targetRegister);
+            case Operation::Pop:
+                return handlePopOperation(stackName, targetRegister);
+            case Operation::Peek:
+                return handlePeekOperation(stackName, targetRegister);
+        }
+        return {};
+    }
+
+    static uint64_t subroutineKey(SymbolId mnemonic, int targetRegister)
+    {
+        return static_cast<uint64_t>(mnemonic) << 3 | static_cast<uint64_t>(targetRegister);
+    }
+
+    /// @brief Returns the subroutine performing the given operation, creating it on first use.
+    Subroutine& getSubroutine(SymbolId mnemonic, Operation operation, SymbolId stackName, int targetRegister)
+    {
+        uint64_t key = subroutineKey(mnemonic, targetRegister);
+        if (auto it = subroutineIndices.find(key); it != subroutineIndices.end()) {
+            return subroutines[it->second];
+        }
+
+        // The callers' liveness is unknown, so the body preserves every register but its target.
+        // ${label} ...the operation, as expanded when every register is live
+        // RET
+        auto& symbols = getSymbolTable();
+        auto  live    = getLiveRegisters();
+        setLiveRegisters(ALL_REGISTERS);
+        auto body = expandInline(operation, stackName, targetRegister);
+        setLiveRegisters(live);
+        std::string name  = operation == Operation::Push ? "_push_R" :
+                            operation == Operation::Pop  ? "_pop_R" : "_peek_R";
+        auto        label = symbols.generate("__stack_impl_" + symbols.getName(stackName) + name +
+                                             std::to_string(targetRegister));
+        body.front() = body.front().withDefinedLabel(label);
+        body.push_back(Instruction::create(Opcode::RET));
+
+        subroutineIndices.emplace(key, subroutines.size());
+        subroutines.push_back({stackName, mnemonic, targetRegister, std::move(body)});
+        return subroutines.back();
+    }
+
+    /// @brief Whether the operations of the named stack call subroutines.
+    [[nodiscard]] bool isOutlined(StackExpansion mode, SymbolId stackName) const
+    {
+        if (mode != StackExpansion::Hybrid) {
+            return mode == StackExpansion::Outlined;
+        }
+        // Without an analysis of the whole program nothing is known to be used often.
+        auto it = stackDepths.find(stackName);
+        return it != stackDepths.end() && it->second.uses >= outlineThreshold;
+    }
+
+    /// @brief Whether a call has to save and restore R7, because the code around it still needs the address it holds.
+    [[nodiscard]] bool isReturnAddressLive() const
+    {
+        return getLiveRegisters() & registerBit(7);
+    }
+
+    /// @brief JSR ${label}, saving and restoring R7 around it if it is live.
+    std::vector<Instruction> createCall(SymbolId label)
+    {
+        auto call = Instruction::create(Opcode::JSR).withLabel(label);
+        if (!isReturnAddressLive()) {
+            return {call};
+        }
+        if (returnAddressSaveLocation == NO_SYMBOL) {
+            returnAddressSaveLocation = getSymbolTable().generate("__stack_impl_return_address");
+        }
+        // ST R7, ${returnAddressSaveLocation}
+        // JSR ${label}
+        // LD R7, ${returnAddressSaveLocation}
+        return {Instruction::create(Opcode::ST, {7}).withLabel(returnAddressSaveLocation), call,
+                Instruction::create(Opcode::LD, {7}).withLabel(returnAddressSaveLocation)};
+    }
+
+    /// @brief Sums the code size of the stacks' operations, were they expanded in the given mode.
+    [[nodiscard]] size_t totalCodeSize(StackExpansion mode) const
+    {
+        size_t total = 0;
+        for (auto& [stackName, size]: codeSizes) {
+            total += isOutlined(mode, stackName) ? size.callWords : size.inlineWords;
+        }
+        for (auto& subroutine: subroutines) {
+            if (isOutlined(mode, subroutine.stackName)) {
+                total += subroutine.body.size();
+            }
+        }
+        return total;
+    }
+
 public:
+    static constexpr std::string_view                NAME      = "STACK";
+    static constexpr int                             PRIORITY  = 0;
+    static constexpr std::array<std::string_view, 3> MNEMONICS = {"PUSH_", "POP_", "PEEK_"};
+
+    [[nodiscard]] std::string getName() override
+    {
+        return std::string(NAME);
+    }
+
+    /// @brief Keeps the pointer of the named stack in the given register instead of in memory, which makes a push or a
+    /// pop two instructions. The register is reserved for the whole program; source which writes it is rejected.
+    /// The stack grows downwards, as the LC3 convention for R6 has it.
+    void useRegisterStack(const std::string& stackName, int stackRegister)
+    {
+        if (stackRegister < 0 || stackRegister > 6) {
+            throw std::invalid_argument("A stack pointer register must be one of R0 to R6.");
+        }
+        for (auto& [name, r]: stackRegisters) {
+            if (r == stackRegister && name != stackName) {
+                throw std::invalid_argument("R" + std::to_string(stackRegister) +
+                                            " already holds the pointer of stack " + name + ".");
+            }
+        }
+        stackRegisters[stackName] = stackRegister;
+    }
+
+    /// @brief Checks at runtime that a stack which may grow without bound does not overflow its storage: a push which
+    /// finds it full halts the machine. Stacks whose depth is bounded are never checked.
+    void setBoundsChecking(bool value)
+    {
+        boundsChecking = value;
+    }
+
+    /// @brief Chooses how operations are expanded. In hybrid mode a stack is outlined if at least threshold lines use
+    /// it. Choosing a mode also asks for a report of the code size under each mode.
+    void setExpansion(StackExpansion mode, size_t threshold)
+    {
+        expansion         = mode;
+        outlineThreshold  = threshold;
+        reportingCodeSize = true;
+    }
+
+    /// @brief Sizes the storage of each stack to the depth it reaches. Stacks already in use are resized, should the
+    /// program have changed since they were first seen.
+    void setStackDepths(const StackDepths& depths) override
+    {
+        stackDepths = depths;
+        for (auto& stack: stacks) {
+            auto it        = stackDepths.find(stack.name);
+            stack.capacity = it != stackDepths.end() && !it->second.unbounded ? std::max(it->second.maximum, 1)
+                                                                              : DEFAULT_CAPACITY;
+        }
+    }
+
+    [[nodiscard]] RegisterSet getClaimedRegisters() override
+    {
+        RegisterSet result = NO_REGISTERS;
+        for (auto& [_, r]: stackRegisters) {
+            result |= registerBit(r);
+        }
+        return result;
+    }
+
     /// @brief Produces initialization logic to be inserted at the beginning of the program.
-    [[nodiscard]] std::vector<std::string> getInitializationLogic() override
+    [[nodiscard]] std::vector<Instruction> getInitializationInstructions() override
     {
-        std::vector<std::string> result;
-        for (auto& stackName: stackNames) {
-            auto [stackPointer, temporarySaveLocation, stackBlockName] = getStackComponents(stackName);
+        std::vector<Instruction> result;
+        for (auto& stack: stacks) {
+            if (stack.stackRegister >= 0) {
+                // LEA ${stackRegister}, ${base}
+                result.push_back(Instruction::create(Opcode::LEA, {stack.stackRegister}).withLabel(stack.base));
+                continue;
+            }
             // LEA R0, ${stackBlockName}
             // ST R0, ${stackPointer}
 
-            result.push_back("LEA R0, " + stackBlockName);
-            result.push_back("ST R0, " + stackPointer);
+            result.push_back(Instruction::create(Opcode::LEA, {0}).withLabel(stack.storage));
+            result.push_back(Instruction::create(Opcode::ST, {0}).withLabel(stack.stackPointer));
         }
         return result;
     }
 
-    [[nodiscard]] std::vector<std::string> getFileEndStatements() override
+    [[nodiscard]] std::vector<Instruction> getFileEndInstructions() override
     {
-        std::vector<std::string> result;
-        for (auto& stackName: stackNames) {
-            auto [stackPointer, temporarySaveLocation, stackBlockName] = getStackComponents(stackName);
-            // __stack_storage_block_${stackName} .BLKW 256
-            // ${stackPointer} .FILL x0
+        std::vector<Instruction> result;
+        for (auto& subroutine: subroutines) {
+            if (subroutine.called) {
+                result.insert(result.end(), subroutine.body.begin(), subroutine.body.end());
+            }
+        }
+        if (returnAddressSaveLocation != NO_SYMBOL) {
+            // ${returnAddressSaveLocation} .FILL x0
+            result.push_back(Instruction::create(Opcode::FILL)
+                                     .withImmediate(0, ImmediateFormat::Hexadecimal)
+                                     .withDefinedLabel(returnAddressSaveLocation));
+        }
+        auto fill = [&](SymbolId label) {
+            result.push_back(Instruction::create(Opcode::FILL)
+                                     .withImmediate(0, ImmediateFormat::Hexadecimal)
+                                     .withDefinedLabel(label));
+        };
+        for (auto& stack: stacks) {
+            // ${storage} .BLKW #${capacity}
+            // ${stackPointer} .FILL x0            (or ${base} .FILL x0 for a register stack)
             // ${temporarySaveLocation} .FILL x0
+            // ${freeSlots} .FILL #${capacity}
 
-            result.push_back(stackBlockName + " .BLKW #32");
-            result.push_back(stackPointer + " .FILL x0");
-            result.push_back(temporarySaveLocation + " .FILL x0");
+            result.push_back(Instruction::create(Opcode::BLKW).withImmediate(stack.capacity)
+                                                             .withDefinedLabel(stack.storage));
+            fill(stack.stackRegister >= 0 ? stack.base : stack.stackPointer);
+            if (stack.temporarySaveLocation != NO_SYMBOL) {
+                fill(stack.temporarySaveLocation);
+            }
+            if (stack.freeSlots != NO_SYMBOL) {
+                result.push_back(Instruction::create(Opcode::FILL).withImmediate(stack.capacity)
+                                                                 .withDefinedLabel(stack.freeSlots));
+            }
         }
         return result;
     }
 
+    [[nodiscard]] std::vector<std::string> getInitializationLogic() override
+    {
+        return Instruction::formatAll(getInitializationInstructions(), getSymbolTable());
+    }
+
+    [[nodiscard]] std::vector<std::string> getFileEndStatements() override
+    {
+        return Instruction::formatAll(getFileEndInstructions(), getSymbolTable());
+    }
+
+    [[nodiscard]] std::vector<std::string> getMnemonics() override
+    {
+        return {MNEMONICS.begin(), MNEMONICS.end()};
+    }
+
     /// @brief Determines what order the PseudoOpCode replacements should be performed in.
     [[nodiscard]] int getPriority() override
     {
-        return 0;
+        return PRIORITY;
     }
 
     /// @brief Determines if the PseudoOpCode can handle the given token.
-    [[nodiscard]] bool canHandle(const std::string& token) override
+    [[nodiscard]] bool canHandle(const Instruction& token) override
     {
         // Possible forms:
         // PUSH_${STACK_NAME} ${REGISTER}
         // POP_${STACK_NAME} ${REGISTER}
         // PEEK_${STACK_NAME} ${REGISTER}
 
-        std::regex pushRegex("PUSH_([A-Za-z0-9]+) R([0-7])");
-        std::regex popRegex("POP_([A-Za-z0-9]+) R([0-7])");
-        std::regex peekRegex("PEEK_([A-Za-z0-9]+) R([0-7])");
+        return token.opcode == Opcode::PSEUDO && token.registerCount == 1 && !token.hasImmediate() &&
+               token.label == NO_SYMBOL && parseMnemonic(token.mnemonic).has_value();
+    }
+
+    /// @brief A push reads its register, a pop or peek overwrites it. Nothing else is visibly changed.
+    [[nodiscard]] RegisterEffects getRegisterEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return RegisterEffects::unknown();
+        }
+        RegisterEffects effects;
+        if (parseMnemonic(token.mnemonic)->operation == Operation::Push) {
+            effects.reads = registerBit(token.registers[0]);
+        }
+        else {
+            effects.writes = registerBit(token.registers[0]);
+        }
+        return effects;
+    }
+
+    /// @brief A push adds one value to its stack and a pop removes one.
+    [[nodiscard]] std::optional<std::vector<StackEffect>> getStackEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return std::nullopt;
+        }
+        auto [operation, stackName] = *parseMnemonic(token.mnemonic);
+        switch (operation) {
+            case Operation::Push:
+                return std::vector<StackEffect>{{stackName, 1, 1}};
+            case Operation::Pop:
+                return std::vector<StackEffect>{{stackName, -1, 0}};
+            case Operation::Peek:
+                break;
+        }
+        return std::vector<StackEffect>();
+    }
 
-        std::smatch pushMatch;
-        std::smatch popMatch;
-        std::smatch peekMatch;
+    /// @brief Inlined operations only depend on the token and the registers; outlined ones, and the code size report,
+    /// keep count of every operation, so they are handled one by one.
+    [[nodiscard]] bool isCacheable(const Instruction& token) override
+    {
+        return !reportingCodeSize && canHandle(token);
+    }
 
-        if (std::regex_match(token, pushMatch, pushRegex)) {
-            return true;
+    /// @brief The stacks kept in registers, the stacks whose bounds are checked and, in hybrid mode, the stacks which
+    /// are outlined.
+    [[nodiscard]] std::string getCacheContext() override
+    {
+        std::vector<std::string> parts;
+        for (auto& [name, r]: stackRegisters) {
+            parts.push_back("R" + std::to_string(r) + "=" + name);
         }
-        else if (std::regex_match(token, popMatch, popRegex)) {
-            return true;
+        for (auto& [stackName, depth]: stackDepths) {
+            if (boundsChecking && depth.unbounded) {
+                parts.push_back("checked=" + getSymbolTable().getName(stackName));
+            }
+            if (expansion == StackExpansion::Hybrid && isOutlined(expansion, stackName)) {
+                parts.push_back("outlined=" + getSymbolTable().getName(stackName));
+            }
         }
-        else if (std::regex_match(token, peekMatch, peekRegex)) {
-            return true;
+        std::sort(parts.begin(), parts.end());
+        std::string context;
+        for (auto& part: parts) {
+            context += context.empty() ? part : " " + part;
         }
+        return context;
+    }
 
-        return false;
+    /// @brief Registers the stack, as handling the token would have.
+    void replayToken(const Instruction& token) override
+    {
+        if (canHandle(token)) {
+            getStack(parseMnemonic(token.mnemonic)->stackName);
+        }
     }
 
     /// @brief Handles the given token.
-    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    [[nodiscard]] std::vector<Instruction> handleToken(const Instruction& token) override
     {
+        if (!canHandle(token)) {
+            throw std::runtime_error(
+                    "Invalid token passed to StackOperations PseudoOpCode: " + token.toString(getSymbolTable()));
+        }
 
-        // Possible forms:
-        // PUSH_${STACK_NAME} ${REGISTER}
-        // POP_${STACK_NAME} ${REGISTER}
-        // PEEK_${STACK_NAME} ${REGISTER}
+        auto [operation, stackName] = *parseMnemonic(token.mnemonic);
+        int  targetRegister         = token.registers[0];
+        auto inlined                = expandInline(operation, stackName, targetRegister);
+        if (!reportingCodeSize) {
+            return inlined;
+        }
 
-        std::regex pushRegex("PUSH_([A-Za-z0-9]+) R([0-7])");
-        std::regex popRegex("POP_([A-Za-z0-9]+) R([0-7])");
-        std::regex peekRegex("PEEK_([A-Za-z0-9]+) R([0-7])");
+        // Both forms are sized, so the report can compare the modes.
+        auto& subroutine = getSubroutine(token.mnemonic, operation, stackName, targetRegister);
+        auto& size       = codeSizes[stackName];
+        size.operations++;
+        size.inlineWords += inlined.size();
+        size.callWords += isReturnAddressLive() ? 3 : 1;
+        if (!isOutlined(expansion, stackName)) {
+            return inlined;
+        }
+        subroutine.called = true;
+        return createCall(subroutine.body.front().definedLabel);
+    }
 
-        std::smatch pushMatch;
-        std::smatch popMatch;
-        std::smatch peekMatch;
+    [[nodiscard]] std::unique_ptr<PseudoOpCode> clone() const override
+    {
+        return std::make_unique<StackOperations>(*this);
+    }
 
-        if (std::regex_match(token, pushMatch, pushRegex)) {
-            return handlePushOperation(pushMatch[1], std::stoi(pushMatch[2]));
+    /// @brief Stacks and subroutines first used by the clone are added after those already known, and the code sizes
+    /// it counted are added to these.
+    void merge(PseudoOpCode& clone, SymbolRemap& symbols) override
+    {
+        auto& other = static_cast<StackOperations&>(clone);
+        for (auto& stack: other.stacks) {
+            getStack(symbols(stack.name));
         }
-        else if (std::regex_match(token, popMatch, popRegex)) {
-            return handlePopOperation(popMatch[1], std::stoi(popMatch[2]));
+        for (auto& subroutine: other.subroutines) {
+            auto key = subroutineKey(symbols(subroutine.mnemonic), subroutine.targetRegister);
+            auto it  = subroutineIndices.find(key);
+            if (it == subroutineIndices.end()) {
+                std::vector<Instruction> body;
+                for (auto& line: subroutine.body) {
+                    body.push_back(line.withSymbolsMapped(symbols));
+                }
+                it = subroutineIndices.emplace(key, subroutines.size()).first;
+                subroutines.push_back({symbols(subroutine.stackName), symbols(subroutine.mnemonic),
+                                       subroutine.targetRegister, std::move(body)});
+            }
+            subroutines[it->second].called |= subroutine.called;
         }
-        else if (std::regex_match(token, peekMatch, peekRegex)) {
-            return handlePeekOperation(peekMatch[1], std::stoi(peekMatch[2]));
+        for (auto& [stackName, size]: other.codeSizes) {
+            auto& total = codeSizes[symbols(stackName)];
+            total.operations += size.operations;
+            total.inlineWords += size.inlineWords;
+            total.callWords += size.callWords;
         }
-        else {
-            throw std::runtime_error("Invalid token passed to StackOperations PseudoOpCode: " + token);
+        if (returnAddressSaveLocation == NO_SYMBOL && other.returnAddressSaveLocation != NO_SYMBOL) {
+            returnAddressSaveLocation = symbols(other.returnAddressSaveLocation);
+        }
+    }
+
+    /// @brief Writes the code size of the stack operations under each expansion mode, if a mode was chosen.
+    void report(std::ostream& diagnostics) override
+    {
+        if (!reportingCodeSize || codeSizes.empty()) {
+            return;
+        }
+        auto& symbols = getSymbolTable();
+        diagnostics << "Stack operations take " << totalCodeSize(StackExpansion::Inline) << " words inlined, "
+                    << totalCodeSize(StackExpansion::Outlined) << " words outlined and "
+                    << totalCodeSize(StackExpansion::Hybrid) << " words hybrid (outlining stacks used at least "
+                    << outlineThreshold << " times); " << totalCodeSize(expansion) << " words were emitted.\n";
+        for (auto& stack: stacks) {
+            auto it = codeSizes.find(stack.name);
+            if (it == codeSizes.end()) {
+                continue;
+            }
+            size_t subroutineWords = 0;
+            for (auto& subroutine: subroutines) {
+                subroutineWords += subroutine.stackName == stack.name ? subroutine.body.size() : 0;
+            }
+            diagnostics << "  " << symbols.getName(stack.name) << ": " << it->second.operations << " operations, "
+                        << it->second.inlineWords << " words inlined, " << it->second.callWords + subroutineWords
+                        << " words outlined (" << it->second.callWords << " at call sites, " << subroutineWords
+                        << " in subroutines), " << (isOutlined(expansion, stack.name) ? "outlined" : "inlined")
+                        << "\n";
         }
     }
+
+    [[nodiscard]] bool canHandle(const std::string& token) override
+    {
+        return canHandle(Instruction::parse(token, getSymbolTable()));
+    }
+
+    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    {
+        return Instruction::formatAll(handleToken(Instruction::parse(token, getSymbolTable())), getSymbolTable());
+    }
 };
 
 
@@ -5,31 +5,82 @@
 #ifndef LC3_LANGUAGE_EXTENDER_STRINGPRINTOPCODE_H
 #define LC3_LANGUAGE_EXTENDER_STRINGPRINTOPCODE_H
 
-#include <iostream>
 #include <algorithm>
-#include <regex>
+#include <array>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include "PseudoOpCode.h"
 
-class StringPrintOpCode : public PseudoOpCode
+class StringPrintOpCode final : public PseudoOpCode
 {
 private:
-    std::vector<std::string> stringInstances;
+    // Distinct string literals in order of first use, and the label each one was given.
+    std::vector<SymbolId>                  stringInstances;
+    std::unordered_map<SymbolId, SymbolId> stringLabels;
+    SymbolId                               pushTempMnemonic = NO_SYMBOL;
+    SymbolId                               popTempMnemonic  = NO_SYMBOL;
+
+    /// @brief Whether every escape sequence in a string literal means the same to every assembler.
+    static bool hasPortableEscapes(std::string_view text)
+    {
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '\\') {
+                continue;
+            }
+            if (++i == text.size() || std::string_view("ntre0\\\"").find(text[i]) == std::string_view::npos) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief What printing a string literal writes to the console: its characters up to the first NUL. std::nullopt if
+    /// the literal has escapes other assemblers may read differently, in which case it is stored exactly as written.
+    std::optional<std::string> getPrintedText(SymbolId value)
+    {
+        auto text = getSymbolTable().getName(value);
+        if (!hasPortableEscapes(text)) {
+            return std::nullopt;
+        }
+        auto decoded = Instruction::decodeString(text);
+        return decoded.substr(0, decoded.find('\0'));
+    }
+
+    /// @brief Spells a string literal the same way as every other literal printing the same text.
+    SymbolId normalize(SymbolId value)
+    {
+        auto text = getPrintedText(value);
+        return text ? getSymbolTable().intern(Instruction::encodeString(*text)) : value;
+    }
 
-    std::string getStringLabel(const std::string& value)
+    SymbolId getStringLabel(SymbolId value)
     {
-        // If stringInstances does not contain value, add it.
-        if (std::find(stringInstances.begin(), stringInstances.end(), value) == stringInstances.end()) {
-            stringInstances.push_back(value);
+        if (auto it = stringLabels.find(value); it != stringLabels.end()) {
+            return it->second;
         }
-        size_t index = std::find(stringInstances.begin(), stringInstances.end(), value) - stringInstances.begin();
-        return "__string_impl_" + std::to_string(index);
+        auto label = getSymbolTable().derive(value, SymbolRole::StringLabel, [&] {
+            return "__string_impl_" + std::to_string(stringInstances.size());
+        });
+        stringInstances.push_back(value);
+        stringLabels.emplace(value, label);
+        return label;
     }
 
 public:
+    static constexpr std::string_view                NAME      = "STRING PRINT";
+    static constexpr int                             PRIORITY  = 0;
+    static constexpr std::array<std::string_view, 1> MNEMONICS = {"PRINT"};
+
     [[nodiscard]] std::string getName() override
     {
-        return "STRING PRINT";
+        return std::string(NAME);
     }
 
     [[nodiscard]] std::vector<std::string> getInitializationLogic() override
@@ -37,38 +88,168 @@ public:
         return {};
     }
 
-    [[nodiscard]] std::vector<std::string> getFileEndStatements() override
+    /// @brief Stores every string once. A non-empty string which ends a longer one is not stored itself: its label
+    /// points into the longer string, whose characters up to that point are stored as .FILLs.
+    [[nodiscard]] std::vector<Instruction> getFileEndInstructions() override
     {
-        std::vector<std::string> result;
-        for (size_t              i = 0; i < stringInstances.size(); i++) {
-            result.push_back("__string_impl_" + std::to_string(i) + " .STRINGZ \"" + stringInstances[i] + "\"");
+        std::vector<std::optional<std::string>> texts;
+        for (auto value: stringInstances) {
+            texts.push_back(getPrintedText(value));
+        }
+        std::vector<size_t> bySize(texts.size());
+        std::iota(bySize.begin(), bySize.end(), 0);
+        std::stable_sort(bySize.begin(), bySize.end(), [&](size_t a, size_t b) {
+            return texts[a].value_or("").size() > texts[b].value_or("").size();
+        });
+
+        // Labels by offset into each stored string; strings ending another are stored as part of it.
+        std::vector<std::map<size_t, SymbolId>> tails(texts.size());
+        std::vector<size_t>                     stored;
+        for (auto i: bySize) {
+            auto label = stringLabels[stringInstances[i]];
+            auto host  = std::find_if(stored.begin(), stored.end(), [&](size_t s) {
+                return texts[i] && !texts[i]->empty() && texts[s] && texts[s]->ends_with(*texts[i]);
+            });
+            if (host == stored.end()) {
+                stored.push_back(i);
+                tails[i][0] = label;
+            }
+            else {
+                tails[*host][texts[*host]->size() - texts[i]->size()] = label;
+            }
+        }
+
+        std::vector<Instruction> result;
+        for (size_t i = 0; i < texts.size(); i++) {
+            if (tails[i].empty()) {
+                continue;
+            }
+            if (!texts[i]) {
+                result.push_back(Instruction::create(Opcode::STRINGZ).withString(stringInstances[i])
+                                                                     .withDefinedLabel(tails[i][0]));
+                continue;
+            }
+            for (auto it = tails[i].begin(); it != tails[i].end(); it++) {
+                auto next = std::next(it);
+                if (next == tails[i].end()) {
+                    auto tail = getSymbolTable().intern(Instruction::encodeString(texts[i]->substr(it->first)));
+                    result.push_back(
+                            Instruction::create(Opcode::STRINGZ).withString(tail).withDefinedLabel(it->second));
+                    break;
+                }
+                for (auto c = it->first; c < next->first; c++) {
+                    auto character = static_cast<unsigned char>((*texts[i])[c]);
+                    auto fill      = Instruction::create(Opcode::FILL)
+                                             .withImmediate(character, ImmediateFormat::Hexadecimal);
+                    result.push_back(c == it->first ? fill.withDefinedLabel(it->second) : fill);
+                }
+            }
         }
         return result;
     }
 
+    [[nodiscard]] std::vector<std::string> getFileEndStatements() override
+    {
+        return Instruction::formatAll(getFileEndInstructions(), getSymbolTable());
+    }
+
+    [[nodiscard]] std::vector<std::string> getMnemonics() override
+    {
+        return {MNEMONICS.begin(), MNEMONICS.end()};
+    }
+
     [[nodiscard]] int getPriority() override
     {
-        return 0;
+        return PRIORITY;
     }
 
-    [[nodiscard]] bool canHandle(const std::string& token) override
+    [[nodiscard]] bool canHandle(const Instruction& token) override
     {
         // Form: PRINT "${content}"
-        return std::regex_match(token, std::regex(R"(PRINT\s+\".*\")"));
+        return token.opcode == Opcode::PSEUDO && token.registerCount == 0 && token.hasString() &&
+               getSymbolTable().getName(token.mnemonic) == "PRINT";
     }
 
-    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    [[nodiscard]] std::vector<Instruction> handleToken(const Instruction& token) override
     {
-        // Form: PRINT "${content}"
-        std::regex  regex(R"(PRINT\s+\"(.*)\")");
-        std::smatch match;
-        std::regex_match(token, match, regex);
-        if (match.size() != 2) {
-            throw std::runtime_error("Invalid token: " + token);
+        if (!canHandle(token)) {
+            throw std::runtime_error("Invalid token: " + token.toString(getSymbolTable()));
+        }
+        if (pushTempMnemonic == NO_SYMBOL) {
+            pushTempMnemonic = getSymbolTable().intern("PUSH_TEMP");
+            popTempMnemonic  = getSymbolTable().intern("POP_TEMP");
+        }
+        auto                     label = getStringLabel(normalize(token.label));
+        std::vector<Instruction> print{Instruction::create(Opcode::LEA, {0}).withLabel(label),
+                                       Instruction::create(Opcode::TRAP).withImmediate(0x22,
+                                                                                       ImmediateFormat::Hexadecimal)};
+        if (!(getLiveRegisters() & registerBit(0))) {
+            return print;
         }
-        std::string content = match[1].str();
-        std::string label   = getStringLabel(content);
-        return {"PUSH_TEMP R0", "LEA R0, " + label, "TRAP x22", "POP_TEMP R0"};
+        // R0 is still needed afterwards, keep it on the stack while it holds the string.
+        std::vector<Instruction> result{Instruction::pseudo(pushTempMnemonic, {0})};
+        result.insert(result.end(), print.begin(), print.end());
+        result.push_back(Instruction::pseudo(popTempMnemonic, {0}));
+        return result;
+    }
+
+    /// @brief Consecutive PRINTs are merged into one PRINT of both strings. A label between them is a line of its own,
+    /// so they are not consecutive.
+    [[nodiscard]] std::optional<Instruction> mergeTokens(const Instruction& first, const Instruction& second) override
+    {
+        if (!canHandle(first) || !canHandle(second)) {
+            return std::nullopt;
+        }
+        auto firstText  = getPrintedText(first.label);
+        auto secondText = getPrintedText(second.label);
+        if (!firstText || !secondText) {
+            return std::nullopt;
+        }
+        return first.withString(getSymbolTable().intern(Instruction::encodeString(*firstText + *secondText)));
+    }
+
+    /// @brief R0 is preserved whenever it is live, so as far as the caller can tell no register is changed (apart from
+    /// R7, which the trap may overwrite).
+    [[nodiscard]] RegisterEffects getRegisterEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return RegisterEffects::unknown();
+        }
+        return {};
+    }
+
+    /// @brief R0 may be kept on the TEMP stack while the string is printed.
+    [[nodiscard]] std::optional<std::vector<StackEffect>> getStackEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return std::nullopt;
+        }
+        return std::vector<StackEffect>{{getSymbolTable().intern("TEMP"), 0, 1}};
+    }
+
+    [[nodiscard]] std::unique_ptr<PseudoOpCode> clone() const override
+    {
+        return std::make_unique<StringPrintOpCode>(*this);
+    }
+
+    /// @brief Strings first used by the clone are numbered after those already known, and its labels are mapped to
+    /// the new numbers.
+    void merge(PseudoOpCode& clone, SymbolRemap& symbols) override
+    {
+        auto& other = static_cast<StringPrintOpCode&>(clone);
+        for (auto value: other.stringInstances) {
+            symbols.set(other.stringLabels[value], getStringLabel(symbols(value)));
+        }
+    }
+
+    [[nodiscard]] bool canHandle(const std::string& token) override
+    {
+        return canHandle(Instruction::parse(token, getSymbolTable()));
+    }
+
+    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    {
+        return Instruction::formatAll(handleToken(Instruction::parse(token, getSymbolTable())), getSymbolTable());
     }
 };
 
@@ -5,17 +5,41 @@
 #ifndef LC3_LANGUAGE_EXTENDER_SUBTRACTOPCODE_H
 #define LC3_LANGUAGE_EXTENDER_SUBTRACTOPCODE_H
 
+#include <array>
 #include <iostream>
+#include <memory>
+#include <string_view>
+#include <utility>
 #include <vector>
-#include <regex>
 #include "PseudoOpCode.h"
 
-class SubtractOpCode : public PseudoOpCode
+class SubtractOpCode final : public PseudoOpCode
 {
+private:
+    SymbolId subtractMnemonic    = NO_SYMBOL;
+    SymbolId pushTempMnemonic    = NO_SYMBOL;
+    SymbolId popTempMnemonic     = NO_SYMBOL;
+    SymbolId addConstantMnemonic = NO_SYMBOL;
+
+    void resolveMnemonics()
+    {
+        if (subtractMnemonic == NO_SYMBOL) {
+            auto& symbols = getSymbolTable();
+            subtractMnemonic    = symbols.intern("SUBTRACT");
+            pushTempMnemonic    = symbols.intern("PUSH_TEMP");
+            popTempMnemonic     = symbols.intern("POP_TEMP");
+            addConstantMnemonic = symbols.intern("ADD_CONSTANT");
+        }
+    }
+
 public:
+    static constexpr std::string_view                NAME      = "SUBTRACT";
+    static constexpr int                             PRIORITY  = 0;
+    static constexpr std::array<std::string_view, 1> MNEMONICS = {"SUBTRACT"};
+
     [[nodiscard]] std::string getName() override
     {
-        return "SUBTRACT";
+        return std::string(NAME);
     }
 
     [[nodiscard]] std::vector<std::string> getInitializationLogic() override
@@ -28,89 +52,149 @@ public:
         return {};
     }
 
+    [[nodiscard]] std::vector<std::string> getMnemonics() override
+    {
+        return {MNEMONICS.begin(), MNEMONICS.end()};
+    }
+
     [[nodiscard]] int getPriority() override
     {
-        return 0;
+        return PRIORITY;
     }
 
-    [[nodiscard]] bool canHandle(const std::string& token) override
+    [[nodiscard]] bool canHandle(const Instruction& token) override
     {
         // Form: SUBTRACT R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, #${VALUE}
         // Or:  SUBTRACT R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, R${SOURCE_REGISTER}
-        std::regex subtractRegex(R"(SUBTRACT R\d{1,2}, R\d{1,2}, (R\d{1,2}|#\d+))");
-        return std::regex_match(token, subtractRegex);
+        resolveMnemonics();
+        if (token.opcode != Opcode::PSEUDO || token.mnemonic != subtractMnemonic) {
+            return false;
+        }
+        if (token.registerCount == 3) {
+            return !token.hasImmediate() && token.label == NO_SYMBOL;
+        }
+        return token.registerCount == 2 && token.hasImmediate();
     }
 
-    std::vector<std::string> createImmediateSubtraction(int destinationRegister, int sourceRegister, int value)
+    /// @brief Picks the register the negated operand is built in. Returns true if it has to be saved and restored.
+    std::pair<int, bool> chooseTempRegister(int destinationRegister, RegisterSet sourceRegisters)
     {
-        std::vector<std::string> result;
-        int                      tempRegister = (destinationRegister + 1) % 7;
-        if (tempRegister == sourceRegister) {
+        // The destination is overwritten anyway, unless the result depends on its old value.
+        if (!(sourceRegisters & registerBit(destinationRegister))) {
+            return {destinationRegister, false};
+        }
+        RegisterSet excluded = sourceRegisters | registerBit(destinationRegister) | getReservedRegisters();
+        if (auto deadRegister = findDeadRegister(excluded, (destinationRegister + 1) % 7)) {
+            return {*deadRegister, false};
+        }
+        int tempRegister = (destinationRegister + 1) % 7;
+        while (excluded & registerBit(tempRegister)) {
             tempRegister = (tempRegister + 1) % 7;
         }
-        // PUSH_TEMP R${TEMP_REGISTER}
-        // AND R${TEMP_REGISTER}, R${TEMP_REGISTER}, #0
-        // ADD R${TEMP_REGISTER}, R${TEMP_REGISTER}, #${VALUE}
-        // NOT R${TEMP_REGISTER}, R${TEMP_REGISTER}
-        // ADD R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, R${TEMP_REGISTER}
-        // POP_TEMP R${TEMP_REGISTER}
-        result.push_back("PUSH_TEMP R" + std::to_string(tempRegister));
-        result.push_back("AND R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister) + ", #0");
-        result.push_back("ADD R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister) + ", #" +
-                         std::to_string(value));
-        result.push_back("NOT R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister));
-        result.push_back(
-                "ADD R" + std::to_string(destinationRegister) + ", R" + std::to_string(sourceRegister) + ", R" +
-                std::to_string(tempRegister));
-        result.push_back("POP_TEMP R" + std::to_string(tempRegister));
-        return result;
+        return {tempRegister, true};
     }
 
-    std::vector<std::string>
+    /// @brief ADD_CONSTANT ${destinationRegister}, ${sourceRegister}, #-${value}, which picks the shortest way to add
+    /// the negated constant.
+    std::vector<Instruction> createImmediateSubtraction(int destinationRegister, int sourceRegister, int32_t value)
+    {
+        resolveMnemonics();
+        auto negated = static_cast<int16_t>(-static_cast<uint16_t>(value));
+        return {Instruction::pseudo(addConstantMnemonic, {destinationRegister, sourceRegister}).withImmediate(negated)};
+    }
+
+    /// @brief ADD ${destinationRegister}, ${sourceRegister}, -${rightSourceRegister}, the negation built in the temp
+    /// register, wrapped in PUSH_TEMP/POP_TEMP if the temp register has to be preserved.
+    std::vector<Instruction>
     createRegisterSubtraction(int destinationRegister, int sourceRegister, int rightSourceRegister)
     {
-        std::vector<std::string> result;
-        int                      tempRegister = (destinationRegister + 1) % 7;
-        if (tempRegister == sourceRegister) {
-            tempRegister = (tempRegister + 1) % 7;
-        }
+        resolveMnemonics();
+        auto [tempRegister, preserve] = chooseTempRegister(destinationRegister, registerBit(sourceRegister) |
+                                                                                registerBit(rightSourceRegister));
         // PUSH_TEMP R${TEMP_REGISTER}
-        // AND R${TEMP_REGISTER}, R${TEMP_REGISTER}, #0
-        // ADD R${TEMP_REGISTER}, R${TEMP_REGISTER}, R${RIGHT_SOURCE_REGISTER}
-        // NOT R${TEMP_REGISTER}, R${TEMP_REGISTER}
+        // NOT R${TEMP_REGISTER}, R${RIGHT_SOURCE_REGISTER}
+        // ADD R${TEMP_REGISTER}, R${TEMP_REGISTER}, #1
         // ADD R${DESTINATION_REGISTER}, R${SOURCE_REGISTER}, R${TEMP_REGISTER}
         // POP_TEMP R${TEMP_REGISTER}
-        result.push_back("PUSH_TEMP R" + std::to_string(tempRegister));
-        result.push_back("AND R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister) + ", #0");
-        result.push_back("ADD R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister) + ", R" +
-                         std::to_string(rightSourceRegister));
-        result.push_back("NOT R" + std::to_string(tempRegister) + ", R" + std::to_string(tempRegister));
-        result.push_back(
-                "ADD R" + std::to_string(destinationRegister) + ", R" + std::to_string(sourceRegister) + ", R" +
-                std::to_string(tempRegister));
-        result.push_back("POP_TEMP R" + std::to_string(tempRegister));
+        std::vector<Instruction> result;
+        if (preserve) {
+            result.push_back(Instruction::pseudo(pushTempMnemonic, {tempRegister}));
+        }
+        result.push_back(Instruction::create(Opcode::NOT, {tempRegister, rightSourceRegister}));
+        result.push_back(Instruction::create(Opcode::ADD, {tempRegister, tempRegister}).withImmediate(1));
+        result.push_back(Instruction::create(Opcode::ADD, {destinationRegister, sourceRegister, tempRegister}));
+        if (preserve) {
+            result.push_back(Instruction::pseudo(popTempMnemonic, {tempRegister}));
+        }
         return result;
     }
 
-    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    /// @brief Reads the source registers and overwrites the destination.
+    [[nodiscard]] RegisterEffects getRegisterEffects(const Instruction& token) override
     {
-        std::regex  subtractRegex(R"(SUBTRACT R(\d{1,2}), R(\d{1,2}), (R\d{1,2}|#\d+))");
-        std::smatch match;
-        std::regex_match(token, match, subtractRegex);
-        bool isImmediate = match[3].str().find('#') != std::string::npos;
-        if (isImmediate) {
-            int destinationRegister = std::stoi(match[1].str());
-            int sourceRegister      = std::stoi(match[2].str());
-            int value               = std::stoi(match[3].str().substr(1));
-            return createImmediateSubtraction(destinationRegister, sourceRegister, value);
+        if (!canHandle(token)) {
+            return RegisterEffects::unknown();
+        }
+        RegisterEffects effects;
+        effects.reads = registerBit(token.registers[1]);
+        if (token.registerCount == 3) {
+            effects.reads |= registerBit(token.registers[2]);
+        }
+        effects.writes = registerBit(token.registers[0]);
+        return effects;
+    }
+
+    /// @brief The temp register may be kept on the TEMP stack, though only when the destination is also a source of a
+    /// register subtraction.
+    [[nodiscard]] std::optional<std::vector<StackEffect>> getStackEffects(const Instruction& token) override
+    {
+        if (!canHandle(token)) {
+            return std::nullopt;
+        }
+        if (token.hasImmediate()) {
+            return std::vector<StackEffect>();
+        }
+        bool destinationIsSource = token.registers[1] == token.registers[0] ||
+                                   (token.registerCount == 3 && token.registers[2] == token.registers[0]);
+        if (!destinationIsSource) {
+            return std::vector<StackEffect>();
+        }
+        return std::vector<StackEffect>{{getSymbolTable().intern("TEMP"), 0, 1}};
+    }
+
+    /// @brief A subtraction only depends on its registers and operand.
+    [[nodiscard]] bool isCacheable(const Instruction& token) override
+    {
+        return canHandle(token);
+    }
+
+    [[nodiscard]] std::vector<Instruction> handleToken(const Instruction& token) override
+    {
+        int destinationRegister = token.registers[0];
+        int sourceRegister      = token.registers[1];
+        if (token.hasImmediate()) {
+            return createImmediateSubtraction(destinationRegister, sourceRegister, token.immediate);
         }
         else {
-            int destinationRegister = std::stoi(match[1].str());
-            int sourceRegister      = std::stoi(match[2].str());
-            int rightSourceRegister = std::stoi(match[3].str().substr(1));
-            return createRegisterSubtraction(destinationRegister, sourceRegister, rightSourceRegister);
+            return createRegisterSubtraction(destinationRegister, sourceRegister, token.registers[2]);
         }
     }
+
+    /// @brief Only the mnemonics are remembered, so a clone has nothing to merge.
+    [[nodiscard]] std::unique_ptr<PseudoOpCode> clone() const override
+    {
+        return std::make_unique<SubtractOpCode>(*this);
+    }
+
+    [[nodiscard]] bool canHandle(const std::string& token) override
+    {
+        return canHandle(Instruction::parse(token, getSymbolTable()));
+    }
+
+    [[nodiscard]] std::vector<std::string> handleToken(const std::string& token) override
+    {
+        return Instruction::formatAll(handleToken(Instruction::parse(token, getSymbolTable())), getSymbolTable());
+    }
 };
 
 
@@ -0,0 +1 @@
+#include "SymbolTable.h"
@@ -0,0 +1,174 @@
+#ifndef LC3_LANGUAGE_EXTENDER_SYMBOLTABLE_H
+#define LC3_LANGUAGE_EXTENDER_SYMBOLTABLE_H
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using SymbolId = uint32_t;
+
+constexpr SymbolId NO_SYMBOL = std::numeric_limits<SymbolId>::max();
+
+/// @brief What a generated symbol is to the symbol it was derived from.
+enum class SymbolRole : uint8_t
+{
+    StackPointer,
+    StackSaveLocation,
+    StackStorage,
+    StackBase,
+    StackFreeSlots,
+    StringLabel,
+};
+
+/// @brief Interns names (labels, mnemonics, string literals) so instructions can refer to them by a small integer id.
+class SymbolTable
+{
+private:
+    // A deque never relocates its elements, so the views used as map keys stay valid as the table grows.
+    std::deque<std::string>                        names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+    std::vector<bool>                              generated;
+    // (base << 8 | role) -> derived symbol
+    std::unordered_map<uint64_t, SymbolId>         derived;
+
+    static uint64_t derivedKey(SymbolId base, SymbolRole role)
+    {
+        return static_cast<uint64_t>(base) << 8 | static_cast<uint8_t>(role);
+    }
+
+public:
+    SymbolTable() = default;
+
+    SymbolTable(const SymbolTable&) = delete;
+
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    /// @brief Makes this table a copy of other, e.g. for a thread expanding part of the program on its own. Symbols
+    /// keep their ids, so lines referring to the first other.size() symbols mean the same in both tables.
+    void copyFrom(const SymbolTable& other)
+    {
+        names     = other.names;
+        generated = other.generated;
+        derived   = other.derived;
+        ids.clear();
+        ids.reserve(names.size());
+        for (size_t id = 0; id < names.size(); id++) {
+            ids.emplace(names[id], static_cast<SymbolId>(id));
+        }
+    }
+
+    /// @brief Returns the id of the given name, adding it to the table if it has not been seen before.
+    SymbolId intern(std::string_view name)
+    {
+        if (auto it = ids.find(name); it != ids.end()) {
+            return it->second;
+        }
+        auto id = static_cast<SymbolId>(names.size());
+        names.emplace_back(name);
+        ids.emplace(names.back(), id);
+        generated.push_back(false);
+        return id;
+    }
+
+    /// @brief Returns the symbol playing the given role for base, e.g. the storage label of a stack.
+    /// The name is only built (by calling makeName) the first time the pair is seen; afterwards this is a single
+    /// hash lookup.
+    template<typename NameFactory>
+    SymbolId derive(SymbolId base, SymbolRole role, NameFactory&& makeName)
+    {
+        auto key = derivedKey(base, role);
+        if (auto it = derived.find(key); it != derived.end()) {
+            return it->second;
+        }
+        auto id       = intern(makeName());
+        generated[id] = true;
+        derived.emplace(key, id);
+        return id;
+    }
+
+    /// @brief Interns a name made up by the translator, marking it as generated. For names which are not tied to a
+    /// single base symbol and role; the caller is expected to remember the result.
+    SymbolId generate(std::string_view name)
+    {
+        auto id       = intern(name);
+        generated[id] = true;
+        return id;
+    }
+
+    /// @brief Returns the symbol playing the given role for base, or NO_SYMBOL if it has not been derived.
+    [[nodiscard]] SymbolId findDerived(SymbolId base, SymbolRole role) const
+    {
+        auto it = derived.find(derivedKey(base, role));
+        return it == derived.end() ? NO_SYMBOL : it->second;
+    }
+
+    /// @brief Whether the symbol was created by derive() rather than appearing in the source.
+    [[nodiscard]] bool isGenerated(SymbolId id) const
+    {
+        return generated[id];
+    }
+
+    /// @brief Returns the id of the given name, or NO_SYMBOL if it has never been interned.
+    [[nodiscard]] SymbolId find(std::string_view name) const
+    {
+        auto it = ids.find(name);
+        return it == ids.end() ? NO_SYMBOL : it->second;
+    }
+
+    [[nodiscard]] const std::string& getName(SymbolId id) const
+    {
+        return names[id];
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return names.size();
+    }
+};
+
+/// @brief Maps the symbols of a copy of a table (see SymbolTable::copyFrom()) back to the original, once both have
+/// grown on their own. Symbols the copy started with keep their id; those added since are looked up by name, unless
+/// set() says otherwise, e.g. for a label whose name was numbered differently in the copy.
+class SymbolRemap
+{
+private:
+    const SymbolTable&    from;
+    SymbolTable&          to;
+    SymbolId              shared;
+    std::vector<SymbolId> ids;
+
+public:
+    /// @brief shared is the number of symbols from had when it was copied.
+    SymbolRemap(const SymbolTable& from, SymbolTable& to, size_t shared) : from(from), to(to),
+                                                                           shared(static_cast<SymbolId>(shared)),
+                                                                           ids(from.size() - shared, NO_SYMBOL)
+    {
+    }
+
+    /// @brief Maps a symbol of the copy to the given symbol of the original.
+    void set(SymbolId id, SymbolId target)
+    {
+        if (id != NO_SYMBOL && id >= shared) {
+            ids[id - shared] = target;
+        }
+    }
+
+    SymbolId operator()(SymbolId id)
+    {
+        if (id == NO_SYMBOL || id < shared) {
+            return id;
+        }
+        auto& target = ids[id - shared];
+        if (target == NO_SYMBOL) {
+            target = from.isGenerated(id) ? to.generate(from.getName(id)) : to.intern(from.getName(id));
+        }
+        return target;
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_SYMBOLTABLE_H
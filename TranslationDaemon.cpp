@@ -0,0 +1 @@
+#include "TranslationDaemon.h"
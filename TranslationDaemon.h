@@ -0,0 +1,210 @@
+#ifndef LC3_LANGUAGE_EXTENDER_TRANSLATIONDAEMON_H
+#define LC3_LANGUAGE_EXTENDER_TRANSLATIONDAEMON_H
+
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "IncrementalTranslator.h"
+#include "Translator.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/// @brief Serves translation requests from an editor, one per line, keeping every opened file translated as it is
+/// edited. Requests:
+///   OPEN INPUT OUTPUT                 translates INPUT into OUTPUT, and keeps it resident
+///   CHANGE FIRST REMOVED ADDED INPUT  INPUT was saved with lines FIRST to FIRST + REMOVED - 1 (counting from 1) of
+///                                     the previous version replaced by ADDED lines; retranslates it into its OUTPUT
+///   CLOSE INPUT                       forgets INPUT
+///   QUIT                              stops serving
+/// Every request is answered with one line: "OK INPUT EXPANDED_LINES TOTAL_LINES MILLISECONDS" (QUIT and CLOSE answer
+/// "OK"), or "ERROR MESSAGE". Paths must not contain whitespace.
+class TranslationDaemon
+{
+private:
+    struct Document
+    {
+        std::filesystem::path output;
+        IncrementalTranslator translator;
+    };
+
+    IncrementalTranslator::Setup                               setup;
+    std::ostream&                                              diagnostics;
+    std::unordered_map<std::string, std::unique_ptr<Document>> documents;
+    bool                                                       quitting = false;
+
+    static std::vector<std::string> readFile(const std::string& path)
+    {
+        std::ifstream input(path);
+        if (!input) {
+            throw std::runtime_error("Unable to open " + path);
+        }
+        return Translator::readSource(input);
+    }
+
+    static void writeFile(Document& document)
+    {
+        std::ofstream output(document.output);
+        document.translator.write(output);
+        if (!output) {
+            throw std::runtime_error("Unable to write " + document.output.string());
+        }
+    }
+
+    static size_t parseCount(std::string_view word)
+    {
+        size_t value = 0;
+        auto [end, error] = std::from_chars(word.data(), word.data() + word.size(), value);
+        if (error != std::errc() || end != word.data() + word.size()) {
+            throw std::runtime_error("Invalid line count: " + std::string(word));
+        }
+        return value;
+    }
+
+    static std::string describe(const std::string& input, const IncrementalTranslator::Update& update,
+                                std::chrono::steady_clock::time_point start)
+    {
+        auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        std::ostringstream response;
+        response << "OK " << input << " " << update.expandedLines << " " << update.totalLines << " "
+                 << milliseconds.count();
+        return response.str();
+    }
+
+    std::string execute(const std::vector<std::string>& words)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (words.size() == 1 && words[0] == "QUIT") {
+            quitting = true;
+            return "OK";
+        }
+        if (words.size() == 3 && words[0] == "OPEN") {
+            auto& document = documents[words[1]];
+            document = std::make_unique<Document>(Document{words[2], IncrementalTranslator(setup, diagnostics)});
+            auto update = document->translator.load(readFile(words[1]));
+            writeFile(*document);
+            return describe(words[1], update, start);
+        }
+        if (words.size() == 5 && words[0] == "CHANGE") {
+            auto it = documents.find(words[4]);
+            if (it == documents.end()) {
+                throw std::runtime_error(words[4] + " is not open");
+            }
+            auto update = it->second->translator.change(readFile(words[4]), parseCount(words[1]),
+                                                        parseCount(words[2]), parseCount(words[3]));
+            writeFile(*it->second);
+            return describe(words[4], update, start);
+        }
+        if (words.size() == 2 && words[0] == "CLOSE") {
+            documents.erase(words[1]);
+            return "OK";
+        }
+        throw std::runtime_error("Unknown request");
+    }
+
+public:
+    TranslationDaemon(IncrementalTranslator::Setup setup, std::ostream& diagnostics) : setup(std::move(setup)),
+                                                                                       diagnostics(diagnostics)
+    {
+    }
+
+    /// @brief Handles one request, returning the response without a line break.
+    std::string handle(std::string_view request)
+    {
+        std::vector<std::string> words;
+        std::istringstream       stream{std::string(request)};
+        for (std::string word; stream >> word;) {
+            words.push_back(std::move(word));
+        }
+        if (words.empty()) {
+            return "ERROR Empty request";
+        }
+        try {
+            return execute(words);
+        }
+        catch (const std::exception& e) {
+            return "ERROR " + std::string(e.what());
+        }
+    }
+
+    /// @brief Answers requests read from input until QUIT or the end of input.
+    void serve(std::istream& input, std::ostream& output)
+    {
+        std::string line;
+        while (!quitting && std::getline(input, line)) {
+            output << handle(line) << "\n" << std::flush;
+        }
+    }
+
+    /// @brief Answers requests from clients connecting to a Unix socket at path, one client at a time, until a client
+    /// sends QUIT. The socket file is replaced if it exists, and removed afterwards.
+    void serveSocket(const std::string& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("The socket path is too long: " + path);
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        int server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0) {
+            throw std::runtime_error("Unable to create a socket.");
+        }
+        unlink(path.c_str());
+        if (bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 4) != 0) {
+            close(server);
+            throw std::runtime_error("Unable to listen on " + path);
+        }
+        while (!quitting) {
+            int client = accept(server, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            std::string buffer;
+            char        chunk[4096];
+            ssize_t     count;
+            while (!quitting && (count = read(client, chunk, sizeof(chunk))) > 0) {
+                buffer.append(chunk, static_cast<size_t>(count));
+                size_t lineEnd;
+                while (!quitting && (lineEnd = buffer.find('\n')) != std::string::npos) {
+                    auto response = handle(std::string_view(buffer).substr(0, lineEnd)) + "\n";
+                    buffer.erase(0, lineEnd + 1);
+                    for (size_t written = 0; written < response.size();) {
+                        auto result = write(client, response.data() + written, response.size() - written);
+                        if (result <= 0) {
+                            break;
+                        }
+                        written += static_cast<size_t>(result);
+                    }
+                }
+            }
+            close(client);
+        }
+        close(server);
+        unlink(path.c_str());
+#else
+        throw std::runtime_error("Unix sockets are not supported on this platform.");
+#endif
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_TRANSLATIONDAEMON_H
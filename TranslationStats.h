@@ -0,0 +1,203 @@
+#ifndef LC3_LANGUAGE_EXTENDER_TRANSLATIONSTATS_H
+#define LC3_LANGUAGE_EXTENDER_TRANSLATIONSTATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "PseudoOpCode.h"
+
+/// @brief How much diagnostic output a translation writes.
+enum class LogLevel
+{
+    /// @brief Nothing but errors.
+    Quiet,
+    /// @brief Warnings about the program, e.g. stacks which may grow without bound.
+    Warning,
+    /// @brief Warnings, plus the summaries of what the optimizer, layout and PseudoOpCodes did. The default.
+    Info,
+    /// @brief Everything, plus a line for every token a PseudoOpCode handles.
+    Debug,
+};
+
+/// @brief What one PseudoOpCode did during a translation.
+struct PseudoOpCodeStats
+{
+    /// @brief Calls of canHandle(), whether they succeeded or not.
+    uint64_t                 canHandleCalls = 0;
+    /// @brief Tokens handled.
+    uint64_t                 hits           = 0;
+    /// @brief Lines returned from handleToken(), before they are expanded further.
+    uint64_t                 linesProduced  = 0;
+    /// @brief Time spent in handleToken().
+    std::chrono::nanoseconds time{};
+};
+
+/// @brief Counters and phase timings of one translation, written as JSON or as a Chrome trace
+/// (chrome://tracing, Perfetto). Collecting them costs a clock read around every handled token, so it is only done
+/// when asked for.
+class TranslationStats
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PhaseEvent
+    {
+        std::string       name;
+        Clock::time_point start;
+        Clock::duration   duration{};
+    };
+
+    Clock::time_point                                     origin = Clock::now();
+    std::vector<PhaseEvent>                               phases;
+    std::unordered_map<PseudoOpCode*, PseudoOpCodeStats>  pseudoOpCodes;
+    size_t                                                maximumDepth = 0;
+    size_t                                                peakLines    = 0;
+    uint64_t                                              cacheHits    = 0;
+    uint64_t                                              storedHits   = 0;
+    uint64_t                                              cacheMisses  = 0;
+
+    static void writeString(std::ostream& out, std::string_view text)
+    {
+        out << '"';
+        for (char c: text) {
+            if (c == '"' || c == '\\') {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    static double seconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    [[nodiscard]] int64_t microseconds(Clock::time_point time) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - origin).count();
+    }
+
+public:
+    /// @brief Times a phase of the translation from its construction until it goes out of scope.
+    class Phase
+    {
+    private:
+        TranslationStats* stats;
+        size_t            index;
+
+    public:
+        Phase(TranslationStats* stats, std::string name) : stats(stats), index(0)
+        {
+            if (stats != nullptr) {
+                index = stats->phases.size();
+                stats->phases.push_back({std::move(name), Clock::now()});
+            }
+        }
+
+        Phase(const Phase&)            = delete;
+        Phase& operator=(const Phase&) = delete;
+
+        ~Phase()
+        {
+            if (stats != nullptr) {
+                auto& phase    = stats->phases[index];
+                phase.duration = Clock::now() - phase.start;
+            }
+        }
+    };
+
+    [[nodiscard]] PseudoOpCodeStats& of(PseudoOpCode* pseudoOpCode)
+    {
+        return pseudoOpCodes[pseudoOpCode];
+    }
+
+    /// @brief Records how many tokens are nested in the expansion currently in progress.
+    void recordDepth(size_t depth)
+    {
+        maximumDepth = std::max(maximumDepth, depth);
+    }
+
+    /// @brief Records the number of lines the program currently has.
+    void recordLines(size_t lines)
+    {
+        peakLines = std::max(peakLines, lines);
+    }
+
+    /// @brief Records how often the expansion cache was used: hits within the translation, hits read from a cache
+    /// file, and misses.
+    void recordCache(uint64_t hits, uint64_t fileHits, uint64_t misses)
+    {
+        cacheHits   = hits;
+        storedHits  = fileHits;
+        cacheMisses = misses;
+    }
+
+    /// @brief Adds the PseudoOpCode counters and expansion depth other collected for another part of the same
+    /// translation. counterpart maps the PseudoOpCodes other counted to those of this translation.
+    template<typename Counterpart>
+    void addCounts(const TranslationStats& other, Counterpart&& counterpart)
+    {
+        for (auto& [pseudoOpCode, entry]: other.pseudoOpCodes) {
+            auto& total = of(counterpart(pseudoOpCode));
+            total.canHandleCalls += entry.canHandleCalls;
+            total.hits += entry.hits;
+            total.linesProduced += entry.linesProduced;
+            total.time += entry.time;
+        }
+        maximumDepth = std::max(maximumDepth, other.maximumDepth);
+    }
+
+    /// @brief Writes the counters of every PseudoOpCode, ordered by name, and the duration of every phase.
+    void writeJson(std::ostream& out) const
+    {
+        std::vector<std::pair<std::string, const PseudoOpCodeStats*>> ordered;
+        for (auto& [pseudoOpCode, entry]: pseudoOpCodes) {
+            ordered.emplace_back(pseudoOpCode->getName(), &entry);
+        }
+        std::sort(ordered.begin(), ordered.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+        out << "{\n  \"pseudoOpCodes\": {";
+        for (size_t i = 0; i < ordered.size(); i++) {
+            auto& entry = *ordered[i].second;
+            out << (i == 0 ? "\n" : ",\n") << "    ";
+            writeString(out, ordered[i].first);
+            out << ": {\"canHandleCalls\": " << entry.canHandleCalls << ", \"hits\": " << entry.hits
+                << ", \"linesProduced\": " << entry.linesProduced << ", \"seconds\": " << seconds(entry.time) << "}";
+        }
+        out << "\n  },\n";
+        out << "  \"maximumExpansionDepth\": " << maximumDepth << ",\n";
+        out << "  \"peakLines\": " << peakLines << ",\n";
+        out << "  \"expansionCache\": {\"hits\": " << cacheHits << ", \"fileHits\": " << storedHits << ", \"misses\": "
+            << cacheMisses << "},\n";
+        out << "  \"phases\": [";
+        for (size_t i = 0; i < phases.size(); i++) {
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+            writeString(out, phases[i].name);
+            out << ", \"seconds\": " << seconds(phases[i].duration) << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    /// @brief Writes every phase as a complete event in the Chrome trace event format.
+    void writeTrace(std::ostream& out) const
+    {
+        out << "{\"traceEvents\": [";
+        for (size_t i = 0; i < phases.size(); i++) {
+            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(phases[i].duration).count();
+            out << (i == 0 ? "\n" : ",\n") << "  {\"name\": ";
+            writeString(out, phases[i].name);
+            out << ", \"cat\": \"translation\", \"ph\": \"X\", \"ts\": " << microseconds(phases[i].start)
+                << ", \"dur\": " << duration << ", \"pid\": 1, \"tid\": 1}";
+        }
+        out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_TRANSLATIONSTATS_H
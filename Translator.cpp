@@ -0,0 +1 @@
+#include "Translator.h"
@@ -0,0 +1,726 @@
+#ifndef LC3_LANGUAGE_EXTENDER_TRANSLATOR_H
+#define LC3_LANGUAGE_EXTENDER_TRANSLATOR_H
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AddressLayout.h"
+#include "Assembler.h"
+#include "ExpansionEngine.h"
+#include "Instruction.h"
+#include "PeepholeOptimizer.h"
+#include "PseudoOpCode.h"
+#include "PseudoOpCodeRegistry.h"
+#include "Simulator.h"
+#include "SourceBuffer.h"
+#include "SymbolTable.h"
+#include "TranslationStats.h"
+
+/// @brief Translates one program. Owns the per-file state: the symbol table and the PseudoOpCode instances, which
+/// remember the stacks and strings the program used.
+class Translator
+{
+private:
+    /// @brief Body lines are spooled to disk in chunks of this size in streaming mode.
+    static constexpr size_t SPOOL_CHUNK_SIZE         = 1 << 16;
+    /// @brief In streaming mode the body is optimized in runs of this many instructions.
+    static constexpr size_t SPOOL_CHUNK_INSTRUCTIONS = 1 << 12;
+    /// @brief write() hands the text to the stream in blocks of about this size.
+    static constexpr size_t WRITE_BUFFER_BYTES       = 1 << 20;
+    /// @brief Expanding on another thread starts with copying the symbols and PseudoOpCodes, which only pays off for
+    /// at least this many lines.
+    static constexpr size_t MINIMUM_LINES_PER_THREAD = 1 << 11;
+
+    /// @brief Copies of the symbol table and PseudoOpCodes, expanding a part of the program on another thread.
+    struct Shard
+    {
+        SymbolTable                                symbols;
+        PseudoOpCodeRegistry                       registry;
+        std::vector<std::unique_ptr<PseudoOpCode>> pseudoOpCodes;
+        ExpansionEngine                            engine;
+        TranslationStats                           stats;
+        std::vector<Instruction>                   output;
+        std::exception_ptr                         error;
+
+        explicit Shard(std::ostream& diagnostics) : registry(symbols), engine(registry, diagnostics)
+        {
+        }
+    };
+
+    std::ostream&                              diagnostics;
+    SymbolTable                                symbols;
+    PseudoOpCodeRegistry                       registry;
+    std::vector<std::unique_ptr<PseudoOpCode>> pseudoOpCodes;
+    ExpansionEngine                            engine;
+    PeepholeOptimizer                          optimizer;
+    AddressLayout                              layout;
+    bool                                       optimizing          = false;
+    bool                                       layingOut           = true;
+    size_t                                     removedInstructions = 0;
+    LogLevel                                   logLevel            = LogLevel::Info;
+    TranslationStats*                          stats               = nullptr;
+    bool                                       cachingToFile       = false;
+    size_t                                     threadCount         = 1;
+
+    /// @brief Removes the comment and surrounding whitespace from a line.
+    static std::string_view stripLine(std::string_view line)
+    {
+        auto pos = line.find(';');
+        if (pos != std::string_view::npos) {
+            line = line.substr(0, pos);
+        }
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos) {
+            return {};
+        }
+        return line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    /// @brief PseudoOpCodes ordered by priority, lowest first, as their prologue and epilogue are inserted.
+    [[nodiscard]] std::vector<PseudoOpCode*> getInsertionOrder() const
+    {
+        auto result = registry.getAll();
+        std::stable_sort(result.begin(), result.end(), [](PseudoOpCode* a, PseudoOpCode* b) {
+            return a->getPriority() < b->getPriority();
+        });
+        return result;
+    }
+
+    /// @brief Marks lines as produced by the PseudoOpCode.
+    std::vector<Instruction> attribute(std::vector<Instruction> lines, PseudoOpCode* pseudoOpCode)
+    {
+        auto producer = symbols.intern(pseudoOpCode->getName());
+        for (auto& line: lines) {
+            line.producer = producer;
+        }
+        return lines;
+    }
+
+    /// @brief Optimizes, formats and spools a run of expanded body instructions, leaving instructions empty.
+    void spool(std::vector<Instruction>& instructions, FILE* file)
+    {
+        recordLines(instructions);
+        optimize(instructions);
+        std::string text;
+        appendLines(instructions, text);
+        fwrite(text.data(), 1, text.size(), file);
+        instructions.clear();
+    }
+
+    /// @brief Tells every PseudoOpCode how deep the stacks get, warning about those which may grow without bound.
+    void distributeStackDepths(const std::vector<Instruction>& program)
+    {
+        auto depths = engine.analyzeStackDepths(program);
+        if (!depths) {
+            return;
+        }
+
+        std::vector<std::pair<SymbolId, StackDepth>> unbounded;
+        std::copy_if(depths->begin(), depths->end(), std::back_inserter(unbounded),
+                     [](auto& entry) { return entry.second.unbounded; });
+        std::sort(unbounded.begin(), unbounded.end(),
+                  [](auto& a, auto& b) { return a.second.growingLine < b.second.growingLine; });
+        for (auto& [stack, depth]: unbounded) {
+            if (logLevel < LogLevel::Warning) {
+                break;
+            }
+            diagnostics << "Warning: stack " << symbols.getName(stack)
+                        << " may grow without bound, it is pushed inside a loop: "
+                        << program[depth.growingLine].toString(symbols) << "\n";
+        }
+        for (auto pseudoOpCode: registry.getAll()) {
+            pseudoOpCode->setStackDepths(*depths);
+        }
+    }
+
+    /// @brief Records the size of the program in the stats, if collecting them.
+    void recordLines(const std::vector<Instruction>& program)
+    {
+        if (stats != nullptr) {
+            stats->recordLines(program.size());
+        }
+    }
+
+    /// @brief readSource(), timed as a phase.
+    std::vector<std::string> read(std::istream& input)
+    {
+        TranslationStats::Phase phase(stats, "read");
+        return readSource(input);
+    }
+
+    /// @brief SourceBuffer::read(), timed as a phase.
+    SourceBuffer load(std::istream& input)
+    {
+        TranslationStats::Phase phase(stats, "read");
+        return SourceBuffer::read(input);
+    }
+
+    /// @brief splitSource(), timed as a phase.
+    std::vector<std::string_view> split(const SourceBuffer& source)
+    {
+        TranslationStats::Phase phase(stats, "split lines");
+        return splitSource(source.getText());
+    }
+
+    /// @brief Copies the symbol table and the PseudoOpCodes for another thread. nullptr if some PseudoOpCode cannot be
+    /// copied.
+    std::unique_ptr<Shard> createShard()
+    {
+        auto shard = std::make_unique<Shard>(diagnostics);
+        shard->symbols.copyFrom(symbols);
+        for (auto& pseudoOpCode: pseudoOpCodes) {
+            auto copy = pseudoOpCode->clone();
+            if (!copy) {
+                return nullptr;
+            }
+            shard->registry.add(copy.get());
+            shard->pseudoOpCodes.push_back(std::move(copy));
+        }
+        shard->engine.setLogLevel(logLevel);
+        if (stats != nullptr) {
+            shard->engine.setStats(&shard->stats);
+        }
+        return shard;
+    }
+
+    /// @brief Expands every line of the analyzed program. A large program is split into one part per thread: the first
+    /// is expanded on this thread, the others by shards. The PseudoOpCodes then merge what the shards recorded, and
+    /// the shards' lines are moved to this symbol table, in program order, so the result is the same as expanding on
+    /// one thread. Programs using an expansion cache file, or logging every token, are always expanded on one thread.
+    std::vector<Instruction> expandAll(const std::vector<Instruction>& program,
+                                       const std::vector<RegisterSet>& liveAfter)
+    {
+        size_t parts = std::min(threadCount, program.size() / MINIMUM_LINES_PER_THREAD);
+        if (parts < 2 || cachingToFile || logLevel >= LogLevel::Debug) {
+            return engine.expandAll(program, liveAfter);
+        }
+        size_t                              shared = symbols.size();
+        std::vector<std::unique_ptr<Shard>> shards;
+        for (size_t i = 1; i < parts; i++) {
+            shards.push_back(createShard());
+            if (!shards.back()) {
+                return engine.expandAll(program, liveAfter);
+            }
+        }
+
+        auto                     bound = [&](size_t part) { return program.size() * part / parts; };
+        std::vector<Instruction> output;
+        output.reserve(program.size());
+        {
+            std::vector<std::jthread> threads;
+            for (size_t i = 1; i < parts; i++) {
+                threads.emplace_back([&, i] {
+                    auto& shard = *shards[i - 1];
+                    try {
+                        for (size_t line = bound(i); line < bound(i + 1); line++) {
+                            shard.engine.expand(program[line], shard.output, liveAfter[line]);
+                        }
+                    }
+                    catch (...) {
+                        shard.error = std::current_exception();
+                    }
+                });
+            }
+            for (size_t line = 0; line < bound(1); line++) {
+                engine.expand(program[line], output, liveAfter[line]);
+            }
+        }
+
+        for (auto& shard: shards) {
+            if (shard->error) {
+                std::rethrow_exception(shard->error);
+            }
+            SymbolRemap remap(shard->symbols, symbols, shared);
+            for (size_t i = 0; i < pseudoOpCodes.size(); i++) {
+                pseudoOpCodes[i]->merge(*shard->pseudoOpCodes[i], remap);
+            }
+            for (auto& line: shard->output) {
+                output.push_back(line.withSymbolsMapped(remap));
+            }
+            engine.getCache().addCounts(shard->engine.getCache());
+            if (stats != nullptr) {
+                stats->addCounts(shard->stats, [&](PseudoOpCode* pseudoOpCode) {
+                    auto it = std::find_if(shard->pseudoOpCodes.begin(), shard->pseudoOpCodes.end(),
+                                           [&](auto& copy) { return copy.get() == pseudoOpCode; });
+                    return pseudoOpCodes[it - shard->pseudoOpCodes.begin()].get();
+                });
+            }
+        }
+        return output;
+    }
+
+    /// @brief Writes what the optimizer and the PseudoOpCodes did to the diagnostics.
+    void reportSummaries()
+    {
+        auto& cache = engine.getCache();
+        if (stats != nullptr) {
+            stats->recordCache(cache.getHits(), cache.getStoredHits(), cache.getMisses());
+        }
+        if (logLevel < LogLevel::Info) {
+            return;
+        }
+        if (optimizing) {
+            diagnostics << "Peephole optimizer removed " << removedInstructions << " instructions.\n";
+        }
+        if (cachingToFile) {
+            diagnostics << "Expansion cache: " << cache.getHits() << " hits, " << cache.getStoredHits()
+                        << " hits from the cache file, " << cache.getMisses() << " misses.\n";
+        }
+        if (layout.getRedirectedCount() > 0) {
+            diagnostics << "Address layout redirected " << layout.getRedirectedCount()
+                        << " out-of-range references through " << layout.getPoolCount() << " pools.\n";
+        }
+        for (auto pseudoOpCode: registry.getAll()) {
+            pseudoOpCode->report(diagnostics);
+        }
+    }
+
+public:
+    explicit Translator(std::ostream& diagnostics) : diagnostics(diagnostics), registry(symbols),
+                                                     engine(registry, diagnostics), optimizer(symbols),
+                                                     layout(symbols)
+    {
+    }
+
+    /// @brief Runs the peephole optimizer over the expanded program.
+    void setOptimizing(bool value)
+    {
+        optimizing = value;
+    }
+
+    /// @brief Checks that every PC-relative operand reaches its label once the program is complete, redirecting those
+    /// which do not. On by default; streaming mode never does it.
+    void setLayingOut(bool value)
+    {
+        layingOut = value;
+    }
+
+    /// @brief Whether the program is changed as a whole once expanded, by the optimizer or the address layout.
+    [[nodiscard]] bool isRewritingProgram() const
+    {
+        return optimizing || layingOut;
+    }
+
+    /// @brief How much is written to the diagnostics. LogLevel::Info by default.
+    void setLogLevel(LogLevel value)
+    {
+        logLevel = value;
+        engine.setLogLevel(value);
+    }
+
+    /// @brief Expands large programs on up to this many threads. 1 by default.
+    void setThreadCount(size_t value)
+    {
+        threadCount = std::max<size_t>(value, 1);
+    }
+
+    /// @brief Collects counters and phase timings into stats, if not nullptr. stats must outlive the translation.
+    void setStats(TranslationStats* value)
+    {
+        stats = value;
+        engine.setStats(value);
+    }
+
+    /// @brief Initialization logic of every PseudoOpCode, in the order it appears after .ORIG.
+    [[nodiscard]] std::vector<Instruction> collectInitializationLogic()
+    {
+        // Each PseudoOpCode's logic is inserted immediately after .ORIG, ahead of what was inserted before it.
+        std::vector<Instruction> result;
+        for (auto pseudoOpCode: getInsertionOrder()) {
+            auto logic = attribute(pseudoOpCode->getInitializationInstructions(), pseudoOpCode);
+            result.insert(result.begin(), logic.begin(), logic.end());
+        }
+        return result;
+    }
+
+    /// @brief File end statements of every PseudoOpCode, in the order they appear before .END.
+    [[nodiscard]] std::vector<Instruction> collectFileEndStatements()
+    {
+        // Each PseudoOpCode's statements are inserted immediately before .END, ahead of what was inserted before it.
+        std::vector<Instruction> result;
+        for (auto pseudoOpCode: getInsertionOrder()) {
+            auto statements = attribute(pseudoOpCode->getFileEndInstructions(), pseudoOpCode);
+            result.insert(result.begin(), statements.begin(), statements.end());
+        }
+        return result;
+    }
+
+    /// @brief Formats the instructions onto out, one per line.
+    void appendLines(const std::vector<Instruction>& instructions, std::string& out) const
+    {
+        for (auto& instruction: instructions) {
+            instruction.appendTo(out, symbols);
+            out += '\n';
+        }
+    }
+
+    /// @brief Loads expansions saved by a previous translation with saveExpansionCache(). Returns false, loading
+    /// nothing, if input does not hold an expansion cache.
+    bool loadExpansionCache(std::istream& input)
+    {
+        cachingToFile = true;
+        return engine.getCache().load(input);
+    }
+
+    /// @brief Saves the expansions of cacheable tokens, for loadExpansionCache() to reuse in a later translation.
+    void saveExpansionCache(std::ostream& output)
+    {
+        cachingToFile = true;
+        engine.getCache().save(output);
+    }
+
+    void addPseudoOpCode(std::unique_ptr<PseudoOpCode> pseudoOpCode)
+    {
+        registry.add(pseudoOpCode.get());
+        pseudoOpCodes.push_back(std::move(pseudoOpCode));
+    }
+
+    [[nodiscard]] SymbolTable& getSymbolTable()
+    {
+        return symbols;
+    }
+
+    /// @brief Reads the program, from the start of the input up to and including the .END directive.
+    static std::vector<std::string> readSource(std::istream& input)
+    {
+        // File Structure:
+        // .ORIG x${SOME_NUMBER}
+        // ...
+        // .END
+
+        std::vector<std::string> content;
+        bool                     foundOrig = false;
+        bool                     foundEnd  = false;
+        std::string              line;
+        while (std::getline(input, line)) {
+            if (line.find(".ORIG") != std::string::npos) {
+                foundOrig = true;
+            }
+            if (line.find(".END") != std::string::npos) {
+                foundEnd = true;
+            }
+            content.push_back(line);
+            if (foundEnd) break;
+        }
+
+        if (!foundOrig) {
+            throw std::runtime_error("No .ORIG directive found.");
+        }
+        if (!foundEnd) {
+            throw std::runtime_error("No .END directive found.");
+        }
+        return content;
+    }
+
+    /// @brief Splits the program, from the start of text up to and including the .END directive, into lines which
+    /// view text, like readSource().
+    static std::vector<std::string_view> splitSource(std::string_view text)
+    {
+        std::vector<std::string_view> content;
+        bool                          foundOrig = false;
+        bool                          foundEnd  = false;
+        while (!foundEnd && !text.empty()) {
+            auto lineEnd = text.find('\n');
+            auto line    = text.substr(0, lineEnd);
+            text.remove_prefix(lineEnd == std::string_view::npos ? text.size() : lineEnd + 1);
+            if (line.find(".ORIG") != std::string_view::npos) {
+                foundOrig = true;
+            }
+            if (line.find(".END") != std::string_view::npos) {
+                foundEnd = true;
+            }
+            content.push_back(line);
+        }
+
+        if (!foundOrig) {
+            throw std::runtime_error("No .ORIG directive found.");
+        }
+        if (!foundEnd) {
+            throw std::runtime_error("No .END directive found.");
+        }
+        return content;
+    }
+
+    /// @brief Removes comments, surrounding whitespace and lines left empty. Returns the line number, counting from 1,
+    /// each remaining line had. Views are only narrowed, never copied.
+    template<typename Line>
+    static std::vector<uint32_t> stripComments(std::vector<Line>& content)
+    {
+        std::vector<uint32_t> lineNumbers;
+        size_t                kept = 0;
+        for (size_t i = 0; i < content.size(); i++) {
+            auto stripped = stripLine(content[i]);
+            if (!stripped.empty()) {
+                content[kept++] = Line(stripped);
+                lineNumbers.push_back(static_cast<uint32_t>(i + 1));
+            }
+        }
+        content.resize(kept);
+        return lineNumbers;
+    }
+
+    /// @brief Parses the program and expands every pseudo-instruction in it. lineNumbers holds the source line number
+    /// of each line of content, which the expanded lines are attributed to.
+    template<typename Line>
+    [[nodiscard]] std::vector<Instruction> expand(const std::vector<Line>& content,
+                                                  const std::vector<uint32_t>& lineNumbers = {})
+    {
+        std::vector<Instruction> program;
+        {
+            TranslationStats::Phase phase(stats, "parse");
+            program = Instruction::parseAll(content, symbols);
+            for (size_t i = 0; i < lineNumbers.size() && i < program.size(); i++) {
+                program[i].sourceLine = lineNumbers[i];
+            }
+        }
+        mergeTokens(program);
+        auto                    liveAfter = analyze(program);
+        TranslationStats::Phase phase(stats, "expansion");
+        auto expanded = expandAll(program, liveAfter);
+        recordLines(expanded);
+        return expanded;
+    }
+
+    /// @brief Merges runs of pseudo-instructions which can be expanded as one, such as consecutive PRINTs. Returns the
+    /// index each remaining line had, or that of the first line merged into it.
+    std::vector<size_t> mergeTokens(std::vector<Instruction>& program)
+    {
+        TranslationStats::Phase phase(stats, "merge");
+        return engine.mergeTokens(program);
+    }
+
+    /// @brief Analyzes the program before it is expanded: tells the PseudoOpCodes how deep the stacks get, and returns
+    /// the registers live after each line.
+    [[nodiscard]] std::vector<RegisterSet> analyze(const std::vector<Instruction>& program)
+    {
+        {
+            TranslationStats::Phase phase(stats, "stack depth analysis");
+            distributeStackDepths(program);
+        }
+        TranslationStats::Phase phase(stats, "liveness analysis");
+        return engine.analyzeLiveness(program);
+    }
+
+    /// @brief Expands a single line of a program which has been analyze()d, appending the result to output.
+    void expandLine(const Instruction& line, std::vector<Instruction>& output, RegisterSet liveAfter)
+    {
+        engine.expand(line, output, liveAfter);
+    }
+
+    /// @brief The getCacheContext() of every PseudoOpCode. Expansions made under one context are only valid under the
+    /// same context.
+    [[nodiscard]] std::string getCacheContext()
+    {
+        std::string context;
+        for (auto pseudoOpCode: registry.getAll()) {
+            context += pseudoOpCode->getName() + ": " + pseudoOpCode->getCacheContext() + "\n";
+        }
+        return context;
+    }
+
+    /// @brief Removes redundant instructions from the expanded program, if optimization is enabled.
+    void optimize(std::vector<Instruction>& program)
+    {
+        if (optimizing) {
+            TranslationStats::Phase phase(stats, "optimization");
+            removedInstructions += optimizer.optimize(program);
+        }
+    }
+
+    /// @brief Inserts the initialization logic after .ORIG and the file end statements before .END.
+    void insertPrologueAndEpilogue(std::vector<Instruction>& program)
+    {
+        TranslationStats::Phase phase(stats, "prologue and epilogue");
+        auto orig = std::find_if(program.begin(), program.end(), [](auto& i) { return i.opcode == Opcode::ORIG; });
+        auto prologue = collectInitializationLogic();
+        program.insert(orig == program.end() ? program.begin() : orig + 1, prologue.begin(), prologue.end());
+
+        auto end = std::find_if(program.begin(), program.end(), [](auto& i) { return i.opcode == Opcode::END; });
+        auto epilogue = collectFileEndStatements();
+        program.insert(end, epilogue.begin(), epilogue.end());
+        recordLines(program);
+    }
+
+    /// @brief Assigns addresses to the complete program, if layout is enabled, so every label is within reach of the
+    /// instructions referring to it.
+    void layOut(std::vector<Instruction>& program)
+    {
+        if (layingOut) {
+            TranslationStats::Phase phase(stats, "address layout");
+            layout.layOut(program);
+            recordLines(program);
+        }
+    }
+
+    /// @brief Writes the program as text. This is the only place text is produced.
+    void write(const std::vector<Instruction>& program, std::ostream& output) const
+    {
+        TranslationStats::Phase phase(stats, "write");
+        std::string text;
+        text.reserve(WRITE_BUFFER_BYTES + WRITE_BUFFER_BYTES / 16);
+        for (auto& instruction: program) {
+            instruction.appendTo(text, symbols);
+            text += '\n';
+            if (text.size() >= WRITE_BUFFER_BYTES) {
+                output.write(text.data(), static_cast<std::streamsize>(text.size()));
+                text.clear();
+            }
+        }
+        output.write(text.data(), static_cast<std::streamsize>(text.size()));
+        output.flush();
+    }
+
+    /// @brief Expands, optimizes and lays out the program read by readSource() or splitSource().
+    template<typename Line>
+    [[nodiscard]] std::vector<Instruction> translateProgram(std::vector<Line> content)
+    {
+        std::vector<uint32_t> lineNumbers;
+        {
+            TranslationStats::Phase phase(stats, "strip comments");
+            lineNumbers = stripComments(content);
+        }
+        auto program = expand(content, lineNumbers);
+        content.clear();
+        optimize(program);
+        insertPrologueAndEpilogue(program);
+        layOut(program);
+        return program;
+    }
+
+    void translate(const SourceBuffer& source, std::ostream& output)
+    {
+        auto program = translateProgram(split(source));
+        write(program, output);
+        reportSummaries();
+    }
+
+    void translate(std::istream& input, std::ostream& output)
+    {
+        translate(load(input), output);
+    }
+
+    /// @brief Translates the program and assembles it, writing an LC3 object file to object and, unless symbolFile is
+    /// nullptr, the addresses of its labels as a symbol file. Throws std::runtime_error if the translation cannot be
+    /// assembled, e.g. when an offset is out of reach without address layout.
+    void assemble(const SourceBuffer& source, std::ostream& object, std::ostream* symbolFile)
+    {
+        auto        program = translateProgram(split(source));
+        Assembler   assembler(symbols);
+        MemoryImage image;
+        {
+            TranslationStats::Phase phase(stats, "assembly");
+            image = assembler.assemble(program);
+        }
+        {
+            TranslationStats::Phase phase(stats, "write");
+            Assembler::writeObject(image, object);
+            if (symbolFile != nullptr) {
+                assembler.writeSymbols(*symbolFile);
+            }
+        }
+        reportSummaries();
+    }
+
+    void assemble(std::istream& input, std::ostream& object, std::ostream* symbolFile)
+    {
+        assemble(load(input), object, symbolFile);
+    }
+
+    /// @brief Translates the program and runs it on the simulator instead of writing it. Whatever follows .END in
+    /// input is the program's keyboard input, and its console output is written to console. What each PseudoOpCode and
+    /// source line cost is reported to the diagnostics.
+    void simulate(std::istream& input, std::ostream& console)
+    {
+        auto source  = read(input);
+        auto program = translateProgram(source);
+        reportSummaries();
+        Simulator simulator(program, symbols);
+        simulator.run(input, console);
+        simulator.report(diagnostics, source);
+    }
+
+    /// @brief Translates while the input is still being read, holding only the symbol tables in memory.
+    /// Everything up to and including .ORIG is written immediately. The expanded body is spooled to a temporary file,
+    /// because the initialization logic which precedes it is only known once the whole body has been seen.
+    /// Lines are expanded before the code following them has been read, so every register is treated as live. The
+    /// optimizer only sees one run of the body at a time, so it may miss the odd redundancy spanning two runs. The body
+    /// is never held as a whole, so there is no address layout: offsets out of reach are left to the assembler.
+    void translateStreaming(std::istream& input, std::ostream& output)
+    {
+        TranslationStats::Phase phase(stats, "streaming translation");
+        std::unique_ptr<FILE, decltype(&fclose)> spoolFile(std::tmpfile(), &fclose);
+        if (!spoolFile) {
+            throw std::runtime_error("Unable to create a temporary file for streaming output.");
+        }
+
+        bool                     foundOrig = false;
+        bool                     foundEnd  = false;
+        std::vector<Instruction> expanded;
+        std::string              text;
+        std::string              line;
+        Instruction              end;
+        while (!foundEnd && std::getline(input, line)) {
+            auto stripped = stripLine(line);
+            if (stripped.empty()) {
+                continue;
+            }
+            auto instruction = Instruction::parse(stripped, symbols);
+            if (instruction.opcode == Opcode::END) {
+                foundEnd = true;
+                end      = instruction;
+                break;
+            }
+            engine.expand(instruction, expanded);
+            if (!foundOrig) {
+                // Nothing is inserted ahead of .ORIG, so everything up to it is final.
+                foundOrig = instruction.opcode == Opcode::ORIG;
+                if (foundOrig) {
+                    appendLines(expanded, text);
+                    output << text << std::flush;
+                    text.clear();
+                    expanded.clear();
+                }
+            }
+            else if (expanded.size() >= SPOOL_CHUNK_INSTRUCTIONS) {
+                spool(expanded, spoolFile.get());
+            }
+        }
+        if (!foundOrig) {
+            throw std::runtime_error("No .ORIG directive found.");
+        }
+        if (!foundEnd) {
+            throw std::runtime_error("No .END directive found.");
+        }
+        spool(expanded, spoolFile.get());
+
+        appendLines(collectInitializationLogic(), text);
+        output << text;
+        text.clear();
+
+        rewind(spoolFile.get());
+        std::vector<char> buffer(SPOOL_CHUNK_SIZE);
+        size_t            count;
+        while ((count = fread(buffer.data(), 1, buffer.size(), spoolFile.get())) > 0) {
+            output.write(buffer.data(), static_cast<std::streamsize>(count));
+        }
+
+        appendLines(collectFileEndStatements(), text);
+        end.appendTo(text, symbols);
+        text += '\n';
+        output << text << std::flush;
+        reportSummaries();
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_TRANSLATOR_H
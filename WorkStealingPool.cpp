@@ -0,0 +1 @@
+#include "WorkStealingPool.h"
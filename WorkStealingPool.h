@@ -0,0 +1,142 @@
+#ifndef LC3_LANGUAGE_EXTENDER_WORKSTEALINGPOOL_H
+#define LC3_LANGUAGE_EXTENDER_WORKSTEALINGPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief Thread pool in which every worker owns a task queue.
+/// Workers take their own tasks newest first and, once out of work, steal the oldest task of another worker, so long
+/// tasks submitted to one queue do not leave the other workers idle.
+class WorkStealingPool
+{
+private:
+    struct Queue
+    {
+        std::mutex                        mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread>            threads;
+    std::mutex                          stateMutex;
+    std::condition_variable             workAvailable;
+    std::condition_variable             allDone;
+    // Tasks submitted but not yet taken, and tasks submitted but not yet finished.
+    size_t                              queued     = 0;
+    size_t                              unfinished = 0;
+    std::atomic<size_t>                 nextQueue  = 0;
+    bool                                stopping   = false;
+
+    bool tryTake(size_t worker, std::function<void()>& task)
+    {
+        for (size_t i = 0; i < queues.size(); i++) {
+            auto& queue = *queues[(worker + i) % queues.size()];
+            std::lock_guard lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void run(size_t worker)
+    {
+        std::function<void()> task;
+        while (true) {
+            {
+                std::unique_lock lock(stateMutex);
+                workAvailable.wait(lock, [&] { return stopping || queued > 0; });
+                if (stopping && queued == 0) {
+                    return;
+                }
+                queued--;
+            }
+            // A task was reserved above, so one of the queues is guaranteed to hold it.
+            while (!tryTake(worker, task)) {
+                std::this_thread::yield();
+            }
+            task();
+            task = nullptr;
+
+            std::lock_guard lock(stateMutex);
+            if (--unfinished == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit WorkStealingPool(size_t threadCount = std::thread::hardware_concurrency())
+    {
+        threadCount = std::max<size_t>(threadCount, 1);
+        for (size_t i = 0; i < threadCount; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard lock(stateMutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+
+    [[nodiscard]] size_t getThreadCount() const
+    {
+        return threads.size();
+    }
+
+    /// @brief Queues a task. Tasks may themselves submit further tasks.
+    void submit(std::function<void()> task)
+    {
+        auto& queue = *queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard lock(stateMutex);
+            queued++;
+            unfinished++;
+        }
+        workAvailable.notify_one();
+    }
+
+    /// @brief Blocks until every submitted task has finished.
+    void wait()
+    {
+        std::unique_lock lock(stateMutex);
+        allDone.wait(lock, [&] { return unfinished == 0; });
+    }
+};
+
+
+#endif //LC3_LANGUAGE_EXTENDER_WORKSTEALINGPOOL_H
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BuiltinPseudoOpCodes.h"
+#include "SourceGenerator.h"
+#include "Translator.h"
+
+#define NON_RESULT_OUT std::cerr
+#define RESULT_OUT std::cout
+
+/// @brief Swallows the translator's diagnostics, so the benchmark measures producing them but not the terminal.
+class DiscardBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+        return count;
+    }
+};
+
+/// @brief How long each phase of one translation took, in seconds, in the order the phases ran.
+using PhaseTimes = std::vector<std::pair<std::string, double>>;
+
+struct BenchmarkSettings
+{
+    SourceMix           mix;
+    std::vector<size_t> sizes;
+    size_t              repetitions = 3;
+    bool                optimizing  = false;
+    bool                layingOut   = false;
+    size_t              threadCount = 1;
+};
+
+struct RunResult
+{
+    size_t                  lines       = 0;
+    size_t                  sourceBytes = 0;
+    size_t                  outputLines = 0;
+    size_t                  outputBytes = 0;
+    /// @brief Every repetition's phase times.
+    std::vector<PhaseTimes> repetitions;
+};
+
+int printUsage(const char* program)
+{
+    NON_RESULT_OUT << "Usage: " << program << " [OPTION...] [--output FILE]\n";
+    NON_RESULT_OUT << "Options: --lines N (repeatable, defaults to 10000, 100000 and 1000000), --repeat N,\n";
+    NON_RESULT_OUT << "         --mix plain=W,stack=W,subtract=W,print=W, --stacks N, --strings N, --seed N,\n";
+    NON_RESULT_OUT << "         --optimize, --layout, --jobs N (defaults to 1)\n";
+    return 1;
+}
+
+template<typename T>
+bool parseNumber(std::string_view value, T& result)
+{
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    return error == std::errc() && end == value.data() + value.size();
+}
+
+/// @brief Parses a comma separated list of KIND=WEIGHT, as given to --mix. Kinds not listed keep their weight.
+bool parseMix(std::string_view value, SourceMix& mix)
+{
+    std::map<std::string_view, uint32_t*> weights = {
+            {"plain",    &mix.plainWeight},
+            {"stack",    &mix.stackWeight},
+            {"subtract", &mix.subtractWeight},
+            {"print",    &mix.printWeight},
+    };
+    while (!value.empty()) {
+        auto entry     = value.substr(0, value.find(','));
+        auto separator = entry.find('=');
+        value.remove_prefix(std::min(value.size(), entry.size() + 1));
+        if (separator == std::string_view::npos) {
+            return false;
+        }
+        auto weight = weights.find(entry.substr(0, separator));
+        if (weight == weights.end() || !parseNumber(entry.substr(separator + 1), *weight->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Translates source once, timing every phase the way Translator::translateProgram() and
+/// Translator::translate() run them.
+PhaseTimes translateOnce(const std::string& source, const BenchmarkSettings& settings, RunResult& result)
+{
+    DiscardBuffer discardBuffer;
+    std::ostream  discard(&discardBuffer);
+    Translator    translator(discard);
+    registerBuiltinPseudoOpCodes(translator);
+    translator.setOptimizing(settings.optimizing);
+    translator.setLayingOut(settings.layingOut);
+    translator.setThreadCount(settings.threadCount);
+
+    PhaseTimes times;
+    auto       start = std::chrono::steady_clock::now();
+    auto       lap   = [&](const char* phase) {
+        auto now = std::chrono::steady_clock::now();
+        times.emplace_back(phase, std::chrono::duration<double>(now - start).count());
+        start = now;
+    };
+
+    auto content = Translator::splitSource(source);
+    lap("ingest");
+    auto lineNumbers = Translator::stripComments(content);
+    lap("strip");
+    auto program = translator.expand(content, lineNumbers);
+    lap("expand");
+    if (settings.optimizing) {
+        translator.optimize(program);
+        lap("optimize");
+    }
+    translator.insertPrologueAndEpilogue(program);
+    lap("prologueEpilogue");
+    if (settings.layingOut) {
+        translator.layOut(program);
+        lap("layout");
+    }
+    std::ostringstream output;
+    translator.write(program, output);
+    lap("output");
+
+    result.outputLines = program.size();
+    result.outputBytes = output.view().size();
+    return times;
+}
+
+/// @brief The median of every phase over the repetitions, and the fastest repetition of every phase.
+void writePhases(const std::vector<PhaseTimes>& repetitions, std::ostream& out)
+{
+    out << "      \"phases\": {";
+    double medianTotal = 0;
+    double bestTotal   = 0;
+    for (size_t phase = 0; phase < repetitions.front().size(); phase++) {
+        std::vector<double> seconds;
+        for (auto& times: repetitions) {
+            seconds.push_back(times[phase].second);
+        }
+        std::sort(seconds.begin(), seconds.end());
+        double median = seconds[seconds.size() / 2];
+        medianTotal += median;
+        bestTotal += seconds.front();
+        out << (phase == 0 ? "\n" : ",\n") << "        \"" << repetitions.front()[phase].first
+            << "\": {\"median\": " << median << ", \"best\": " << seconds.front() << "}";
+    }
+    out << "\n      },\n";
+    out << "      \"total\": {\"median\": " << medianTotal << ", \"best\": " << bestTotal << "}\n";
+}
+
+void writeReport(const BenchmarkSettings& settings, const std::vector<RunResult>& results, std::ostream& out)
+{
+    auto& mix = settings.mix;
+    out << "{\n";
+    out << "  \"unit\": \"seconds\",\n";
+    out << "  \"repetitions\": " << settings.repetitions << ",\n";
+    out << "  \"optimize\": " << (settings.optimizing ? "true" : "false") << ",\n";
+    out << "  \"layout\": " << (settings.layingOut ? "true" : "false") << ",\n";
+    out << "  \"jobs\": " << settings.threadCount << ",\n";
+    out << "  \"mix\": {\"plain\": " << mix.plainWeight << ", \"stack\": " << mix.stackWeight << ", \"subtract\": "
+        << mix.subtractWeight << ", \"print\": " << mix.printWeight << ", \"stacks\": " << mix.stackCount
+        << ", \"strings\": " << mix.stringCount << ", \"seed\": " << mix.seed << "},\n";
+    out << "  \"runs\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"lines\": " << result.lines << ",\n";
+        out << "      \"sourceBytes\": " << result.sourceBytes << ",\n";
+        out << "      \"outputLines\": " << result.outputLines << ",\n";
+        out << "      \"outputBytes\": " << result.outputBytes << ",\n";
+        writePhases(result.repetitions, out);
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    std::string       outputPath;
+    for (int i = 1; i < argc; i++) {
+        std::string_view argument = argv[i];
+        bool             valid    = true;
+        if (argument == "--optimize") {
+            settings.optimizing = true;
+        }
+        else if (argument == "--layout") {
+            settings.layingOut = true;
+        }
+        else if (argument == "--lines" && i + 1 < argc) {
+            size_t lines = 0;
+            valid = parseNumber(argv[++i], lines);
+            settings.sizes.push_back(lines);
+        }
+        else if (argument == "--jobs" && i + 1 < argc) {
+            valid = parseNumber(argv[++i], settings.threadCount) && settings.threadCount > 0;
+        }
+        else if (argument == "--repeat" && i + 1 < argc) {
+            valid = parseNumber(argv[++i], settings.repetitions) && settings.repetitions > 0;
+        }
+        else if (argument == "--mix" && i + 1 < argc) {
+            valid = parseMix(argv[++i], settings.mix);
+        }
+        else if (argument == "--stacks" && i + 1 < argc) {
+            valid = parseNumber(argv[++i], settings.mix.stackCount);
+        }
+        else if (argument == "--strings" && i + 1 < argc) {
+            valid = parseNumber(argv[++i], settings.mix.stringCount);
+        }
+        else if (argument == "--seed" && i + 1 < argc) {
+            valid = parseNumber(argv[++i], settings.mix.seed);
+        }
+        else if (argument == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+        else {
+            NON_RESULT_OUT << "Unknown argument: " << argument << "\n";
+            return printUsage(argv[0]);
+        }
+        if (!valid) {
+            NON_RESULT_OUT << "Invalid value for " << argument << ": " << argv[i] << "\n";
+            return printUsage(argv[0]);
+        }
+    }
+    if (settings.sizes.empty()) {
+        settings.sizes = {10'000, 100'000, 1'000'000};
+    }
+
+    std::vector<RunResult> results;
+    for (auto lines: settings.sizes) {
+        settings.mix.lines = lines;
+        auto      source   = SourceGenerator(settings.mix).generate();
+        RunResult result;
+        result.lines       = lines;
+        result.sourceBytes = source.size();
+        try {
+            for (size_t repetition = 0; repetition < settings.repetitions; repetition++) {
+                result.repetitions.push_back(translateOnce(source, settings, result));
+            }
+        }
+        catch (const std::exception& error) {
+            NON_RESULT_OUT << "Translating " << lines << " lines failed: " << error.what() << "\n";
+            return 1;
+        }
+        NON_RESULT_OUT << "Translated " << lines << " lines " << settings.repetitions << " times.\n";
+        results.push_back(std::move(result));
+    }
+
+    if (outputPath.empty()) {
+        writeReport(settings, results, RESULT_OUT);
+        return 0;
+    }
+    std::ofstream output(outputPath);
+    writeReport(settings, results, output);
+    if (!output) {
+        NON_RESULT_OUT << "Unable to write " << outputPath << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,148 +1,369 @@
 #include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
-#include "PseudoOpCode.h"
-#include "StackOperations.h"
-#include "StringPrintOpCode.h"
-#include "SubtractOpCode.h"
+#include "BatchTranslator.h"
+#include "BuiltinPseudoOpCodes.h"
+#include "SourceBuffer.h"
+#include "TranslationDaemon.h"
+#include "Translator.h"
 
 #define NON_RESULT_OUT std::cerr
 #define RESULT_OUT std::cout
 
-const int MAXIMUM_ITERATIONS = 5000;
+int printUsage(const char* program)
+{
+    NON_RESULT_OUT << "Usage: " << program << " [OPTION...] < input.asm > output.asm\n";
+    NON_RESULT_OUT << "       " << program << " [OPTION...] --emit obj [--symbols FILE] < input.asm > output.obj\n";
+    NON_RESULT_OUT << "       " << program << " [OPTION...] --batch OUTPUT_DIR INPUT...\n";
+    NON_RESULT_OUT << "       " << program << " [OPTION...] --simulate < input.asm > console.txt\n";
+    NON_RESULT_OUT << "       " << program << " [OPTION...] --daemon | --daemon-socket PATH\n";
+    NON_RESULT_OUT << "Options: --stream, --optimize, --no-layout, --register-stack NAME[=Rn] (Rn defaults to R6),\n";
+    NON_RESULT_OUT << "         --stack-checks, --stack-mode inline|outline|hybrid[=N] (N defaults to 4),\n";
+    NON_RESULT_OUT << "         --log-level quiet|warning|info|debug (defaults to info), --stats FILE, --trace FILE,\n";
+    NON_RESULT_OUT << "         --expansion-cache FILE,\n";
+    NON_RESULT_OUT << "         --jobs N (defaults to 1, or to the number of cores with --batch)\n";
+    NON_RESULT_OUT << "Except in batch and daemon mode, input.asm may be given as an argument instead of on stdin.\n";
+    return 1;
+}
+
+/// @brief Parses NAME or NAME=Rn, as given to --register-stack.
+std::optional<std::pair<std::string, int>> parseRegisterStack(std::string_view value)
+{
+    int  stackRegister = 6;
+    auto separator     = value.find('=');
+    if (separator != std::string_view::npos) {
+        auto name = value.substr(separator + 1);
+        if (name.size() != 2 || (name[0] != 'R' && name[0] != 'r') || name[1] < '0' || name[1] > '6') {
+            return std::nullopt;
+        }
+        stackRegister = name[1] - '0';
+        value         = value.substr(0, separator);
+    }
+    if (value.empty() ||
+        !std::all_of(value.begin(), value.end(), [](char c) { return isalnum(static_cast<unsigned char>(c)); })) {
+        return std::nullopt;
+    }
+    return std::pair{std::string(value), stackRegister};
+}
+
+/// @brief Parses quiet, warning, info or debug, as given to --log-level.
+std::optional<LogLevel> parseLogLevel(std::string_view value)
+{
+    if (value == "quiet") {
+        return LogLevel::Quiet;
+    }
+    if (value == "warning") {
+        return LogLevel::Warning;
+    }
+    if (value == "info") {
+        return LogLevel::Info;
+    }
+    if (value == "debug") {
+        return LogLevel::Debug;
+    }
+    return std::nullopt;
+}
+
+/// @brief Writes the stats as JSON to statsPath and as a Chrome trace to tracePath, skipping empty paths.
+bool writeStats(const TranslationStats& stats, const std::string& statsPath, const std::string& tracePath)
+{
+    bool success        = true;
+    if (!statsPath.empty()) {
+        std::ofstream output(statsPath);
+        stats.writeJson(output);
+        success = success && output;
+    }
+    if (!tracePath.empty()) {
+        std::ofstream output(tracePath);
+        stats.writeTrace(output);
+        success = success && output;
+    }
+    return success;
+}
 
-int main()
+/// @brief Parses inline, outline, hybrid or hybrid=N, as given to --stack-mode.
+bool parseStackMode(std::string_view value, BuiltinOptions& options)
 {
-    std::vector<PseudoOpCode*> pseudoOpCodes;
-    pseudoOpCodes.push_back(new StackOperations());
-    pseudoOpCodes.push_back(new StringPrintOpCode());
-    pseudoOpCodes.push_back(new SubtractOpCode());
-
-
-    // Sort by priority.
-    std::sort(pseudoOpCodes.begin(), pseudoOpCodes.end(), [](PseudoOpCode* a, PseudoOpCode* b) {
-        return a->getPriority() > b->getPriority();
-    });
-
-    std::vector<std::string> content;
-
-    // File Structure:
-    // .ORIG x${SOME_NUMBER}
-    // ...
-    // .END
-
-    {
-        bool        foundOrig = false;
-        bool        foundEnd  = false;
-        std::string line;
-        while (std::getline(std::cin, line)) {
-            if (line.find(".ORIG") != std::string::npos) {
-                foundOrig = true;
+    if (value == "inline" || value == "outline") {
+        options.stackExpansion = value == "inline" ? StackExpansion::Inline : StackExpansion::Outlined;
+        return true;
+    }
+    if (!value.starts_with("hybrid")) {
+        return false;
+    }
+    value.remove_prefix(std::string_view("hybrid").size());
+    options.stackExpansion = StackExpansion::Hybrid;
+    if (value.empty()) {
+        return true;
+    }
+    if (value.front() != '=') {
+        return false;
+    }
+    value.remove_prefix(1);
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), options.outlineThreshold);
+    return error == std::errc() && end == value.data() + value.size();
+}
+
+int main(int argc, char* argv[])
+{
+    bool                               streaming      = false;
+    bool                               optimizing     = false;
+    bool                               layingOut      = true;
+    bool                               batch          = false;
+    bool                               simulating     = false;
+    bool                               emittingObject = false;
+    std::string                        symbolPath;
+    bool                               daemon         = false;
+    std::string                        socketPath;
+    LogLevel                           logLevel       = LogLevel::Info;
+    std::string                        statsPath;
+    std::string                        tracePath;
+    std::string                        cachePath;
+    BuiltinOptions                     options;
+    // Expanding one file on several threads has not been measured to pay off, so only batch mode defaults to more.
+    std::optional<size_t>              jobs;
+    std::filesystem::path              outputDirectory;
+    std::vector<std::filesystem::path> inputs;
+    std::filesystem::path              inputPath;
+    for (int i = 1; i < argc; i++) {
+        std::string_view argument = argv[i];
+        if (argument == "--stream") {
+            streaming = true;
+        }
+        else if (argument == "--optimize") {
+            optimizing = true;
+        }
+        else if (argument == "--simulate") {
+            simulating = true;
+        }
+        else if (argument == "--daemon") {
+            daemon = true;
+        }
+        else if (argument == "--daemon-socket" && i + 1 < argc) {
+            daemon     = true;
+            socketPath = argv[++i];
+        }
+        else if (argument == "--emit" && i + 1 < argc) {
+            std::string_view format = argv[++i];
+            if (format != "asm" && format != "obj") {
+                NON_RESULT_OUT << "Invalid output format: " << format << "\n";
+                return printUsage(argv[0]);
             }
-            if (line.find(".END") != std::string::npos) {
-                foundEnd = true;
+            emittingObject = format == "obj";
+        }
+        else if (argument == "--symbols" && i + 1 < argc) {
+            symbolPath = argv[++i];
+        }
+        else if (argument == "--no-layout") {
+            layingOut = false;
+        }
+        else if (argument == "--stack-checks") {
+            options.stackBoundsChecking = true;
+        }
+        else if (argument == "--stack-mode" && i + 1 < argc) {
+            if (!parseStackMode(argv[++i], options)) {
+                NON_RESULT_OUT << "Invalid stack mode: " << argv[i] << "\n";
+                return printUsage(argv[0]);
             }
-            content.push_back(line);
-            if (foundEnd) break;
         }
-
-        if (!foundOrig) {
-            throw std::runtime_error("No .ORIG directive found.");
+        else if (argument == "--log-level" && i + 1 < argc) {
+            auto level = parseLogLevel(argv[++i]);
+            if (!level) {
+                NON_RESULT_OUT << "Invalid log level: " << argv[i] << "\n";
+                return printUsage(argv[0]);
+            }
+            logLevel = *level;
         }
-        if (!foundEnd) {
-            throw std::runtime_error("No .END directive found.");
+        else if (argument == "--stats" && i + 1 < argc) {
+            statsPath = argv[++i];
         }
-    }
-
-    {
-        // Remove comments
-        for (int i = 0; i < content.size(); i++) {
-            auto& line = content[i];
-            auto pos = line.find(';');
-            if (pos != std::string::npos) {
-                line = line.substr(0, pos);
+        else if (argument == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if (argument == "--expansion-cache" && i + 1 < argc) {
+            cachePath = argv[++i];
+        }
+        else if (argument == "--register-stack" && i + 1 < argc) {
+            auto registerStack = parseRegisterStack(argv[++i]);
+            if (!registerStack) {
+                NON_RESULT_OUT << "Invalid register stack: " << argv[i] << "\n";
+                return printUsage(argv[0]);
             }
+            options.registerStacks.push_back(*registerStack);
         }
-
-        // Remove lines that are empty or only contain whitespace
-        for (int i = 0; i < content.size(); i++) {
-            auto& line = content[i];
-            if (line.find_first_not_of(' ') == std::string::npos) {
-                content.erase(content.begin() + i);
-                i--;
+        else if (argument == "--batch" && i + 1 < argc) {
+            batch           = true;
+            outputDirectory = argv[++i];
+        }
+        else if (argument == "--jobs" && i + 1 < argc) {
+            std::string_view value = argv[++i];
+            size_t           count = 0;
+            auto [_, error] = std::from_chars(value.data(), value.data() + value.size(), count);
+            if (error != std::errc() || count == 0) {
+                NON_RESULT_OUT << "Invalid job count: " << value << "\n";
+                return printUsage(argv[0]);
             }
+            jobs = count;
         }
-
-        // Remove leading and trailing whitespace
-        for (int i = 0; i < content.size(); i++) {
-            auto& line = content[i];
-            line = line.substr(line.find_first_not_of(' '));
-            line = line.substr(0, line.find_last_not_of(' ') + 1);
+        else if (batch && !argument.starts_with("--")) {
+            inputs.emplace_back(argument);
+        }
+        else if (!batch && inputPath.empty() && !argument.starts_with("--")) {
+            inputPath = argument;
+        }
+        else {
+            NON_RESULT_OUT << "Unknown argument: " << argument << "\n";
+            return printUsage(argv[0]);
         }
     }
 
+    if (simulating && (streaming || batch)) {
+        NON_RESULT_OUT << "--simulate cannot be combined with --stream or --batch.\n";
+        return printUsage(argv[0]);
+    }
 
-    for (int i = 0;; i++) {
-        bool modified = false;
-        for (auto pseudoOpCode: pseudoOpCodes) {
-            for (int j = 0; j < content.size(); j++) {
-                if (pseudoOpCode->canHandle(content[j])) {
-                    NON_RESULT_OUT << "PseudoOpCode " << pseudoOpCode->getName() << " handling token " << content[j] << "\n";
-                    auto result = pseudoOpCode->handleToken(content[j]);
-                    content.erase(content.begin() + j);
-                    content.insert(content.begin() + j, result.begin(), result.end());
-                    modified = true;
-                }
-            }
-        }
-        if (!modified) {
-            break;
-        }
+    if (emittingObject && (streaming || simulating || daemon)) {
+        NON_RESULT_OUT << "--emit obj cannot be combined with --stream, --simulate or --daemon.\n";
+        return printUsage(argv[0]);
+    }
 
-        if (i > MAXIMUM_ITERATIONS) {
-            throw std::runtime_error("Maximum iterations exceeded.");
-        }
+    if (!symbolPath.empty() && (!emittingObject || batch)) {
+        NON_RESULT_OUT << "--symbols requires --emit obj, and batch mode writes a .sym file next to every .obj.\n";
+        return printUsage(argv[0]);
     }
 
-    // Sort by priority, lowest first
-    std::sort(pseudoOpCodes.begin(), pseudoOpCodes.end(), [](PseudoOpCode* a, PseudoOpCode* b) {
-        return a->getPriority() < b->getPriority();
-    });
+    if (daemon && (streaming || batch || simulating || !statsPath.empty() || !tracePath.empty() ||
+                   !cachePath.empty() || !inputPath.empty())) {
+        NON_RESULT_OUT << "--daemon cannot be combined with --stream, --batch, --simulate, --stats, --trace, "
+                          "--expansion-cache or an input file.\n";
+        return printUsage(argv[0]);
+    }
 
-    // Get line with '.ORIG x3000'
-    size_t   origLine = 0;
-    for (int i        = 0; i < content.size(); i++) {
-        if (content[i].find(".ORIG") != std::string::npos) {
-            origLine = i;
-            break;
-        }
+    if (batch && (!statsPath.empty() || !tracePath.empty() || !cachePath.empty())) {
+        NON_RESULT_OUT << "--stats, --trace and --expansion-cache cannot be combined with --batch.\n";
+        return printUsage(argv[0]);
     }
 
-    // Insert all initialization logic immediately after .ORIG
-    for (auto pseudoOpCode: pseudoOpCodes) {
-        auto result = pseudoOpCode->getInitializationLogic();
-        content.insert(content.begin() + origLine + 1, result.begin(), result.end());
+    if (batch) {
+        if (inputs.empty()) {
+            NON_RESULT_OUT << "No input files given.\n";
+            return printUsage(argv[0]);
+        }
+        BatchTranslator batchTranslator(outputDirectory, options, streaming, optimizing, layingOut, emittingObject,
+                                        jobs.value_or(std::thread::hardware_concurrency()));
+        auto            results = batchTranslator.translate(inputs);
+        BatchTranslator::writeReport(results, RESULT_OUT);
+        return std::all_of(results.begin(), results.end(), [](auto& result) { return result.success; }) ? 0 : 1;
     }
 
-    // Get line with '.END'
-    size_t   endLine = 0;
-    for (int i       = 0; i < content.size(); i++) {
-        if (content[i].find(".END") != std::string::npos) {
-            endLine = i;
-            break;
+    if (daemon) {
+        TranslationDaemon translationDaemon([&](Translator& translator) {
+            registerBuiltinPseudoOpCodes(translator, options);
+            translator.setOptimizing(optimizing);
+            translator.setLayingOut(layingOut);
+            translator.setLogLevel(logLevel);
+        }, NON_RESULT_OUT);
+        if (socketPath.empty()) {
+            translationDaemon.serve(std::cin, RESULT_OUT);
+        }
+        else {
+            try {
+                translationDaemon.serveSocket(socketPath);
+            }
+            catch (const std::exception& e) {
+                NON_RESULT_OUT << e.what() << "\n";
+                return 1;
+            }
         }
+        return 0;
     }
 
-    // Insert all file end statements immediately before .END
-    for (auto pseudoOpCode: pseudoOpCodes) {
-        auto result = pseudoOpCode->getFileEndStatements();
-        content.insert(content.begin() + endLine, result.begin(), result.end());
+    Translator translator(NON_RESULT_OUT);
+    registerBuiltinPseudoOpCodes(translator, options);
+    translator.setOptimizing(optimizing);
+    translator.setLayingOut(layingOut);
+    translator.setLogLevel(logLevel);
+    translator.setThreadCount(jobs.value_or(1));
+    TranslationStats stats;
+    bool             collectingStats = !statsPath.empty() || !tracePath.empty();
+    if (collectingStats) {
+        translator.setStats(&stats);
+    }
+    if (!cachePath.empty()) {
+        std::ifstream cacheFile(cachePath);
+        if (cacheFile && !translator.loadExpansionCache(cacheFile)) {
+            NON_RESULT_OUT << cachePath << " is not an expansion cache, it will be overwritten.\n";
+        }
     }
 
-    for (auto line: content) {
-        RESULT_OUT << line << std::endl;
+    // Translation and assembly map the input file; the other modes read it as a stream.
+    std::ifstream inputFile;
+    if (!inputPath.empty() && (simulating || streaming)) {
+        inputFile.open(inputPath);
+        if (!inputFile) {
+            NON_RESULT_OUT << "Unable to open " << inputPath.string() << ".\n";
+            return 1;
+        }
     }
+    std::istream& input = inputFile.is_open() ? inputFile : std::cin;
 
+    // Errors in the program, e.g. a write to a reserved register, are reported without writing anything more.
+    try {
+        if (simulating) {
+            translator.simulate(input, RESULT_OUT);
+        }
+        else if (emittingObject) {
+            std::ofstream symbolFile;
+            if (!symbolPath.empty()) {
+                symbolFile.open(symbolPath);
+                if (!symbolFile) {
+                    NON_RESULT_OUT << "Unable to open the symbol file " << symbolPath << ".\n";
+                    return 1;
+                }
+            }
+            auto symbols = symbolPath.empty() ? nullptr : &symbolFile;
+            if (inputPath.empty()) {
+                translator.assemble(std::cin, RESULT_OUT, symbols);
+            }
+            else {
+                translator.assemble(SourceBuffer::map(inputPath), RESULT_OUT, symbols);
+            }
+        }
+        else if (streaming) {
+            translator.translateStreaming(input, RESULT_OUT);
+        }
+        else if (inputPath.empty()) {
+            translator.translate(std::cin, RESULT_OUT);
+        }
+        else {
+            translator.translate(SourceBuffer::map(inputPath), RESULT_OUT);
+        }
+    }
+    catch (const std::exception& e) {
+        NON_RESULT_OUT << e.what() << "\n";
+        return 1;
+    }
 
+    if (!cachePath.empty()) {
+        std::ofstream cacheFile(cachePath);
+        translator.saveExpansionCache(cacheFile);
+        if (!cacheFile) {
+            NON_RESULT_OUT << "Unable to write the expansion cache " << cachePath << ".\n";
+            return 1;
+        }
+    }
+    if (collectingStats && !writeStats(stats, statsPath, tracePath)) {
+        NON_RESULT_OUT << "Unable to write the stats.\n";
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,25 @@
+# Translates INPUT with OPTIONS, runs it on the simulator and checks that it prints what EXPECTED holds. --simulate
+# cannot be combined with --stream, so a streamed translation is written to NAME.asm and simulated on its own.
+cmake_minimum_required(VERSION 3.25)
+
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+if ("--stream" IN_LIST options)
+    execute_process(COMMAND ${TRANSLATOR} ${options} INPUT_FILE ${INPUT} OUTPUT_FILE ${NAME}.asm
+                    ERROR_VARIABLE errors RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Translating ${INPUT} failed:\n${errors}")
+    endif ()
+    set(INPUT ${NAME}.asm)
+    set(options "")
+endif ()
+
+execute_process(COMMAND ${TRANSLATOR} --simulate ${options} INPUT_FILE ${INPUT}
+                OUTPUT_VARIABLE printed ERROR_VARIABLE errors RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "Simulating ${INPUT} failed:\n${errors}")
+endif ()
+file(READ ${EXPECTED} expected)
+string(STRIP "${expected}" expected)
+if (NOT printed STREQUAL expected)
+    message(FATAL_ERROR "${INPUT} printed \"${printed}\" instead of \"${expected}\"")
+endif ()
@@ -0,0 +1,20 @@
+.ORIG x3000
+AND R1, R1, #0
+LEA R0, FAR
+BRz NEAR
+PRINT "fail"
+HALT
+NEAR LD R2, FAR
+LDR R3, R0, #0
+NOT R3, R3
+ADD R3, R3, #1
+ADD R3, R2, R3
+BRnp WRONG
+PRINT "ok"
+HALT
+WRONG
+PRINT "wrong address"
+HALT
+.BLKW #300
+FAR .FILL #1234
+.END
@@ -0,0 +1,20 @@
+.ORIG x3000
+AND R2, R2, #0
+ADD R2, R2, #5
+AND R1, R1, #0
+STI R2, POINTER
+BRz STORED
+PRINT "fail"
+HALT
+STORED LD R3, CELL
+ADD R3, R3, #-5
+BRnp WRONG
+PRINT "ok"
+HALT
+WRONG
+PRINT "wrong value"
+HALT
+CELL .FILL #0
+.BLKW #300
+POINTER .FILL CELL
+.END
@@ -0,0 +1,22 @@
+.ORIG x3000
+AND R0, R0, #0
+ADD R0, R0, #3
+AND R1, R1, #0
+ADD R1, R1, #4
+PUSH_STACK1 R0
+PUSH_STACK2 R1
+PEEK_STACK1 R4
+POP_STACK1 R2
+POP_STACK2 R3
+ADD R2, R2, #-3
+BRnp FAIL
+ADD R3, R3, #-4
+BRnp FAIL
+ADD R4, R4, #-3
+BRnp FAIL
+PRINT "ok"
+HALT
+FAIL
+PRINT "fail"
+HALT
+.END
@@ -0,0 +1,6 @@
+.ORIG x3000
+PRINT "Hello, world!"
+PRINT "Hello, world!"
+PRINT "Testing!"
+HALT
+.END